@@ -0,0 +1,556 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "util.h"
+#include "vars.h"
+#include "ast.h"
+
+/*
+ * Control flow is parsed once into a tree of nodes and then run by
+ * msh's interpreter as often as it likes: the words of each command
+ * are copied out of the arena into the tree when it is built, and a
+ * loop body reuses them on every pass, expanding only the words that
+ * use a variable that has changed.
+ *
+ * The grammar, over the tokens of tokenize (newlines included):
+ *
+ *   list     := { and_or ( ; | newline | & ) }
+ *   and_or   := pipeline { ( && | || ) newline* pipeline }
+ *   pipeline := [ ! ] command
+ *   command  := if list then list { elif list then list } [ else list ] fi
+ *             | while list do list done | until list do list done
+ *             | for NAME in word... ( ; | newline ) newline* do list done
+ *             | simple
+ *   simple   := the words up to the next ;, &, &&, || or newline,
+ *               with | and the redirections left for eval to split
+ *
+ * Keywords are only keywords where a command starts (and "in" and
+ * "do" in a for). Only a simple command may run in the background.
+ */
+
+struct parser_t {
+    char **tok;             /* the next token */
+    int status;             /* PARSE_OK, or why parsing stopped */
+};
+
+/* Words of these keywords end a list */
+static const char *closers[] = {
+    "then", "elif", "else", "fi", "do", "done", NULL
+};
+
+static const char *keywords[] = {
+    "if", "then", "elif", "else", "fi", "while", "until", "do", "done",
+    "for", "!", NULL
+};
+
+static struct node_t *list(struct parser_t *p);
+
+
+/* xcalloc - calloc that gives up on the shell if memory runs out */
+static void *xcalloc(size_t n, size_t size)
+{
+    void *q;
+
+    if ((q = calloc(n, size)) == NULL)
+	unix_error("calloc error");
+    return q;
+}
+
+/* inlist - Is s one of the strings in the NULL terminated words? */
+static int inlist(const char *s, const char **words)
+{
+    for (; *words != NULL; words++)
+	if (!strcmp(s, *words))
+	    return 1;
+    return 0;
+}
+
+/* iskeyword - Does word start or end a compound command? */
+int iskeyword(const char *word)
+{
+    return inlist(word, keywords);
+}
+
+/* isctl - Does tok end a simple command? */
+static int isctl(const char *tok)
+{
+    return tok == semitok || tok == nltok || tok == andtok || tok == ortok
+	|| tok == bgtok;
+}
+
+/* isoptok - Is tok an operator token rather than a word? */
+static int isoptok(const char *tok)
+{
+    return isctl(tok) || tok == pipetok || tok == intok || tok == outtok
+	|| tok == appendtok || tok == errtok || tok == errappendtok
+	|| tok == errouttok;
+}
+
+/* at - Is the next token the keyword kw? */
+static int at(struct parser_t *p, const char *kw)
+{
+    return *p->tok != NULL && !isoptok(*p->tok) && !strcmp(*p->tok, kw);
+}
+
+/* atcloser - Is the next token a keyword that ends a list? */
+static int atcloser(struct parser_t *p)
+{
+    return *p->tok != NULL && !isoptok(*p->tok) && inlist(*p->tok, closers);
+}
+
+/*
+ * fail - Stop parsing at the next token: if there is none the commands
+ *     are only incomplete, otherwise report it. Returns NULL.
+ */
+static void *fail(struct parser_t *p)
+{
+    if (p->status != PARSE_OK)
+	return NULL;
+    if (*p->tok == NULL) {
+	p->status = PARSE_MORE;
+	return NULL;
+    }
+    printf("syntax error near unexpected token `%s'\n",
+	   *p->tok == nltok ? "newline" : *p->tok);
+    p->status = PARSE_ERROR;
+    return NULL;
+}
+
+/* expect - Take the keyword kw, or fail. Returns 1 if it was there. */
+static int expect(struct parser_t *p, const char *kw)
+{
+    if (!at(p, kw)) {
+	fail(p);
+	return 0;
+    }
+    p->tok++;
+    return 1;
+}
+
+/* skipnl - Step over newlines */
+static void skipnl(struct parser_t *p)
+{
+    while (*p->tok == nltok)
+	p->tok++;
+}
+
+/* newnode - A node of the given type with the given operands */
+static struct node_t *newnode(int type, struct node_t *left,
+			      struct node_t *right)
+{
+    struct node_t *n = xcalloc(1, sizeof(*n));
+
+    n->type = type;
+    n->left = left;
+    n->right = right;
+    return n;
+}
+
+/*
+ * initwords - Copy the n words at src into w, skipping the newlines
+ *     that follow a |. Operator tokens stay the tokens themselves, so
+ *     they can still be told from words by their address.
+ */
+static void initwords(struct words_t *w, char **src, int n)
+{
+    char *m;
+    int i;
+
+    w->argc = n;
+    w->tmpl = xcalloc(n + 1, sizeof(char *));
+    w->val = xcalloc(n + 1, sizeof(char *));
+    w->argv = xcalloc(n + 1, sizeof(char *));
+    w->dyn = xcalloc(n + 1, 1);
+    w->gen = xcalloc(n + 1, sizeof(unsigned long));
+    w->size = xcalloc(n + 1, sizeof(size_t));
+    w->stale = 1;
+    for (i = 0; i < n; i++, src++) {
+	while (*src == nltok)
+	    src++;
+	if (isoptok(*src)) {
+	    w->tmpl[i] = w->val[i] = *src;
+	    continue;
+	}
+	if ((w->tmpl[i] = strdup(*src)) == NULL)
+	    unix_error("strdup error");
+	if ((m = strchr(w->tmpl[i], VARMARK)) == NULL) {
+	    w->val[i] = w->tmpl[i];
+	    continue;
+	}
+	w->dyn[i] = 1;
+	for (; m != NULL; m = strchr(m + 1, VARMARK))
+	    if (m[1] == '?')
+		w->dyn[i] = 2;
+    }
+}
+
+/* freewords - Free what initwords and expandwords allocated */
+static void freewords(struct words_t *w)
+{
+    int i;
+
+    for (i = 0; i < w->argc; i++) {
+	if (w->dyn[i])
+	    free(w->val[i]);
+	if (!isoptok(w->tmpl[i]))
+	    free(w->tmpl[i]);
+    }
+    free(w->tmpl);
+    free(w->val);
+    free(w->argv);
+    free(w->dyn);
+    free(w->gen);
+    free(w->size);
+    free(w->text);
+}
+
+/* freenode - Free the tree at n, along with the rest of its list */
+void freenode(struct node_t *n)
+{
+    struct node_t *next;
+
+    for (; n != NULL; n = next) {
+	next = n->next;
+	freenode(n->left);
+	freenode(n->right);
+	freenode(n->other);
+	if (n->words.tmpl != NULL)
+	    freewords(&n->words);
+	free(n->name);
+	free(n);
+    }
+}
+
+/*
+ * simple - A simple command: the words up to the next control
+ *     operator. A | may end a line, with the command going on in the
+ *     next one.
+ */
+static struct node_t *simple(struct parser_t *p)
+{
+    struct node_t *n;
+    char **t, *last = NULL;
+    int count = 0;
+
+    for (t = p->tok; *t != NULL && !isctl(*t); t++) {
+	count++;
+	if ((last = *t) == pipetok)
+	    while (t[1] == nltok)
+		t++;
+    }
+    if (*t == NULL && last == pipetok) {
+	p->tok = t;
+	return fail(p);
+    }
+    n = newnode(N_CMD, NULL, NULL);
+    initwords(&n->words, p->tok, count);
+    p->tok = t;
+    return n;
+}
+
+/* body - A list that must have a command in it */
+static struct node_t *body(struct parser_t *p)
+{
+    struct node_t *n = list(p);
+
+    if (n == NULL)
+	return fail(p);
+    return n;
+}
+
+/* ifcmd - if ... fi, or the rest of one from an elif */
+static struct node_t *ifcmd(struct parser_t *p)
+{
+    struct node_t *n = newnode(N_IF, NULL, NULL);
+
+    p->tok++;
+    if ((n->left = body(p)) == NULL || !expect(p, "then")
+	|| (n->right = body(p)) == NULL) {
+	freenode(n);
+	return NULL;
+    }
+    if (at(p, "elif")) {
+	if ((n->other = ifcmd(p)) == NULL) {
+	    freenode(n);
+	    return NULL;
+	}
+	return n;
+    }
+    if ((at(p, "else") && (p->tok++, (n->other = body(p)) == NULL))
+	|| !expect(p, "fi")) {
+	freenode(n);
+	return NULL;
+    }
+    return n;
+}
+
+/* loopcmd - while ... done or until ... done */
+static struct node_t *loopcmd(struct parser_t *p, int type)
+{
+    struct node_t *n = newnode(type, NULL, NULL);
+
+    p->tok++;
+    if ((n->left = body(p)) == NULL || !expect(p, "do")
+	|| (n->right = body(p)) == NULL || !expect(p, "done")) {
+	freenode(n);
+	return NULL;
+    }
+    return n;
+}
+
+/* forcmd - for NAME in words; do ... done */
+static struct node_t *forcmd(struct parser_t *p)
+{
+    struct node_t *n = newnode(N_FOR, NULL, NULL);
+    char **t;
+
+    p->tok++;
+    if (*p->tok == NULL || isoptok(*p->tok)
+	|| !isname(*p->tok, strlen(*p->tok))) {
+	freenode(n);
+	return fail(p);
+    }
+    if ((n->name = strdup(*p->tok++)) == NULL)
+	unix_error("strdup error");
+    if (!expect(p, "in")) {
+	freenode(n);
+	return NULL;
+    }
+    for (t = p->tok; *t != NULL && !isoptok(*t); t++)
+	;
+    if (*t != semitok && *t != nltok) {
+	p->tok = t;
+	freenode(n);
+	return fail(p);
+    }
+    initwords(&n->words, p->tok, t - p->tok);
+    p->tok = t + 1;
+    skipnl(p);
+    if (!expect(p, "do") || (n->right = body(p)) == NULL
+	|| !expect(p, "done")) {
+	freenode(n);
+	return NULL;
+    }
+    return n;
+}
+
+/* command - A compound or simple command */
+static struct node_t *command(struct parser_t *p)
+{
+    char *t = *p->tok;
+
+    if (t == NULL || isctl(t) || t == pipetok || atcloser(p))
+	return fail(p);
+    if (at(p, "if"))
+	return ifcmd(p);
+    if (at(p, "while"))
+	return loopcmd(p, N_WHILE);
+    if (at(p, "until"))
+	return loopcmd(p, N_UNTIL);
+    if (at(p, "for"))
+	return forcmd(p);
+    return simple(p);
+}
+
+/* pipeline - A command, maybe with its status negated by ! */
+static struct node_t *pipeline(struct parser_t *p)
+{
+    struct node_t *n;
+
+    if (!at(p, "!"))
+	return command(p);
+    p->tok++;
+    if ((n = command(p)) == NULL)
+	return NULL;
+    return newnode(N_NOT, n, NULL);
+}
+
+/* andor - Pipelines joined by && and || */
+static struct node_t *andor(struct parser_t *p)
+{
+    struct node_t *left, *right;
+    int type;
+
+    if ((left = pipeline(p)) == NULL)
+	return NULL;
+    while (*p->tok == andtok || *p->tok == ortok) {
+	type = *p->tok++ == andtok ? N_AND : N_OR;
+	skipnl(p);
+	if ((right = pipeline(p)) == NULL) {
+	    freenode(left);
+	    return NULL;
+	}
+	left = newnode(type, left, right);
+    }
+    return left;
+}
+
+/*
+ * list - Commands separated by ;, & and newlines, up to the end of
+ *     the tokens or a keyword that ends a list. Returns NULL if there
+ *     are none, or if parsing failed.
+ */
+static struct node_t *list(struct parser_t *p)
+{
+    struct node_t *head = NULL, **tail = &head, *n;
+
+    while (1) {
+	while (*p->tok == semitok || *p->tok == nltok)
+	    p->tok++;
+	if (*p->tok == NULL || atcloser(p))
+	    return head;
+	if ((n = andor(p)) == NULL)
+	    break;
+	*tail = n;
+	tail = &n->next;
+	if (*p->tok == bgtok && n->type == N_CMD) {
+	    n->bg = 1;
+	    p->tok++;
+	} else if (*p->tok == semitok || *p->tok == nltok) {
+	    p->tok++;
+	} else if (*p->tok != NULL && !atcloser(p)) {
+	    fail(p);
+	    break;
+	}
+    }
+    freenode(head);
+    return NULL;
+}
+
+/*
+ * parse - Build the tree of the NULL terminated tokens. Returns
+ *     PARSE_OK with the tree (NULL if there were no commands) in
+ *     *tree, PARSE_MORE if the tokens stop inside a command, or
+ *     PARSE_ERROR after reporting a syntax error.
+ */
+int parse(char **tokens, struct node_t **tree)
+{
+    struct parser_t p = { tokens, PARSE_OK };
+
+    *tree = list(&p);
+    if (p.status == PARSE_OK && *p.tok != NULL)
+	fail(&p);
+    if (p.status != PARSE_OK) {
+	freenode(*tree);
+	*tree = NULL;
+    }
+    return p.status;
+}
+
+/* putval - Append the n bytes at s to word i's value at *len */
+static void putval(struct words_t *w, int i, size_t *len, const char *s,
+		   size_t n)
+{
+    size_t size = w->size[i] ? w->size[i] : 32;
+
+    while (*len + n + 1 > size)
+	size *= 2;
+    if (size != w->size[i]) {
+	if ((w->val[i] = realloc(w->val[i], size)) == NULL)
+	    unix_error("realloc error");
+	w->size[i] = size;
+    }
+    memcpy(w->val[i] + *len, s, n);
+    *len += n;
+    w->val[i][*len] = '\0';
+}
+
+/*
+ * expandword - Expand word i of w again: each VARMARK and the name
+ *     after it (NAME, {NAME} or ?) becomes the variable's value, or
+ *     nothing if it is not set.
+ */
+static void expandword(struct words_t *w, int i, int status)
+{
+    const char *s = w->tmpl[i], *e, *name, *v;
+    char buf[MAXLINE];
+    size_t len = 0, n;
+
+    putval(w, i, &len, "", 0);
+    while (*s != '\0') {
+	if (*s != VARMARK) {
+	    e = strchr(s, VARMARK);
+	    n = e ? (size_t) (e - s) : strlen(s);
+	    putval(w, i, &len, s, n);
+	    s += n;
+	    continue;
+	}
+	s++;
+	if (*s == '?') {
+	    n = snprintf(buf, sizeof(buf), "%d", status);
+	    putval(w, i, &len, buf, n);
+	    s++;
+	    continue;
+	}
+	if (*s == '{') {
+	    if ((e = strchr(s, '}')) == NULL || !isname(s + 1, e - s - 1)) {
+		putval(w, i, &len, "$", 1);     /* not ours to expand */
+		continue;
+	    }
+	    name = s + 1;
+	    n = e - name;
+	    s = e + 1;
+	} else {
+	    for (name = s; isalnum((unsigned char) *s) || *s == '_'; s++)
+		;
+	    n = s - name;
+	}
+	if (n < sizeof(buf)) {
+	    memcpy(buf, name, n);
+	    buf[n] = '\0';
+	    if ((v = getvar(buf)) != NULL)
+		putval(w, i, &len, v, strlen(v));
+	}
+    }
+    w->gen[i] = vargen;
+    w->stale = 1;
+}
+
+/*
+ * expandwords - Bring the words of w up to date, with status as $?,
+ *     and return a copy of them the caller may change, NULL terminated
+ */
+char **expandwords(struct words_t *w, int status)
+{
+    int i;
+
+    for (i = 0; i < w->argc; i++)
+	if (w->dyn[i] == 2 || (w->dyn[i] && w->gen[i] != vargen))
+	    expandword(w, i, status);
+    memcpy(w->argv, w->val, (w->argc + 1) * sizeof(char *));
+    return w->argv;
+}
+
+/*
+ * wordstext - The expanded words of w as a command line, with a
+ *     trailing " &" if bg and a newline, as eval is given one
+ */
+char *wordstext(struct words_t *w, int bg)
+{
+    size_t len = 0, n;
+    int i;
+
+    if (!w->stale)
+	return w->text;
+    for (i = 0; i < w->argc; i++)
+	len += strlen(w->val[i]) + 1;
+    if (len + 3 > w->textsize) {
+	if ((w->text = realloc(w->text, len + 3)) == NULL)
+	    unix_error("realloc error");
+	w->textsize = len + 3;
+    }
+    for (i = len = 0; i < w->argc; i++) {
+	n = strlen(w->val[i]);
+	memcpy(w->text + len, w->val[i], n);
+	len += n;
+	w->text[len++] = ' ';
+    }
+    if (len > 0 && !bg)
+	len--;
+    if (bg)
+	w->text[len++] = '&';
+    strcpy(w->text + len, "\n");
+    w->stale = 0;
+    return w->text;
+}
@@ -0,0 +1,58 @@
+#ifndef _AST_H_
+#define _AST_H_
+
+#include <stddef.h>
+
+/* Kinds of node */
+#define N_CMD    0          /* a simple command or pipeline */
+#define N_AND    1          /* left && right */
+#define N_OR     2          /* left || right */
+#define N_NOT    3          /* ! left */
+#define N_IF     4          /* if left; then right; else other; fi */
+#define N_WHILE  5          /* while left; do right; done */
+#define N_UNTIL  6          /* until left; do right; done */
+#define N_FOR    7          /* for name in words; do right; done */
+
+/*
+ * The words of a command, as parsed and as last expanded. Operator
+ * tokens and words with nothing to expand are used as they are. A
+ * word with a VARMARK in it is expanded again only when a variable
+ * has changed since it last was, or every time if it uses $?.
+ * Expansions are not split into more words.
+ */
+struct words_t {
+    int argc;
+    char **tmpl;            /* the words as parsed */
+    char **val;             /* what each stands for now */
+    char **argv;            /* a copy of val to run, NULL terminated */
+    char *dyn;              /* per word: 0 plain, 1 has $, 2 has $? */
+    unsigned long *gen;     /* vargen each was expanded at */
+    size_t *size;           /* bytes allocated for each val */
+    char *text;             /* val as a command line, for the job list */
+    size_t textsize;
+    int stale;              /* text needs building again */
+};
+
+/* A command; the lists after ; and newline are chained by next */
+struct node_t {
+    int type;               /* N_CMD ... N_FOR */
+    struct node_t *next;    /* next command of its list */
+    struct node_t *left;    /* operand or condition */
+    struct node_t *right;   /* second operand, then part or loop body */
+    struct node_t *other;   /* else part; an elif is an N_IF here */
+    char *name;             /* N_FOR: the loop variable */
+    struct words_t words;   /* N_CMD: its words; N_FOR: those looped over */
+    int bg;                 /* N_CMD: runs in the background */
+};
+
+#define PARSE_OK     0
+#define PARSE_MORE   1      /* the commands go on past the last token */
+#define PARSE_ERROR -1      /* a syntax error, already reported */
+
+int iskeyword(const char *word);
+int parse(char **tokens, struct node_t **tree);
+void freenode(struct node_t *n);
+char **expandwords(struct words_t *w, int status);
+char *wordstext(struct words_t *w, int bg);
+
+#endif
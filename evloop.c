@@ -0,0 +1,129 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/syscall.h>
+#include "evloop.h"
+
+/*
+ * The event loop is an alternative to running the shell's signal
+ * handlers asynchronously. The signals are blocked for good and read
+ * from a signalfd instead, each child gets a pidfd that becomes
+ * readable when it exits, and the command input is polled alongside
+ * both, all in one epoll set. Handlers then run synchronously from evwait, at a
+ * point where the shell is not in the middle of touching the job list.
+ *
+ * pidfds only report exits, so stopped children are still noticed
+ * through SIGCHLD on the signalfd. Kernels without pidfd_open fall
+ * back to SIGCHLD alone.
+ */
+
+#define MAXEVENTS 16
+
+static int epfd = -1;              /* the epoll set */
+static int sigfd = -1;             /* signalfd for the blocked signals */
+static int infd = -1;              /* where the shell reads commands */
+static int inpoll;                 /* infd can be polled */
+static int inarmed;                /* infd is armed in the epoll set */
+static handler_t *evhandler;       /* called for each signal or exit */
+
+
+/*
+ * evinit - Block sigs, start reading them from a signalfd and route
+ *     them, along with child exits, to handler. Commands are read from
+ *     fd, or from nowhere if it is -1.
+ */
+void evinit(const sigset_t *sigs, handler_t *handler, int fd)
+{
+    struct epoll_event ev;
+
+    evhandler = handler;
+    if (sigprocmask(SIG_BLOCK, sigs, NULL) < 0)
+	unix_error("sigprocmask error");
+    if ((sigfd = signalfd(-1, sigs, SFD_NONBLOCK | SFD_CLOEXEC)) < 0)
+	unix_error("signalfd error");
+    if ((epfd = epoll_create1(EPOLL_CLOEXEC)) < 0)
+	unix_error("epoll_create1 error");
+
+    ev.events = EPOLLIN;
+    ev.data.fd = sigfd;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, sigfd, &ev) < 0)
+	unix_error("epoll_ctl error");
+
+    /* The input is added disarmed; evwait arms it only when the caller
+     * wants input, so pending input cannot spin a foreground wait.
+     * Regular files cannot be polled and are always readable. */
+    infd = fd;
+    ev.events = EPOLLONESHOT;
+    ev.data.fd = infd;
+    inpoll = infd >= 0 && epoll_ctl(epfd, EPOLL_CTL_ADD, infd, &ev) == 0;
+}
+
+/* evwatchpid - Watch for the exit of child pid */
+void evwatchpid(pid_t pid)
+{
+    struct epoll_event ev;
+    int fd;
+
+    if ((fd = syscall(SYS_pidfd_open, pid, 0)) < 0)
+	return;
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0)
+	close(fd);
+}
+
+/* drainsignals - Hand every pending signal to the handler */
+static void drainsignals(void)
+{
+    struct signalfd_siginfo si;
+
+    while (read(sigfd, &si, sizeof(si)) == sizeof(si))
+	evhandler(si.ssi_signo);
+}
+
+/*
+ * evwait - Sleep until something happens and dispatch it. Returns 1
+ *     if wantinput is set and the input is readable, 0 otherwise. An
+ *     input that cannot be polled is always readable, so then evwait
+ *     only dispatches what is already pending.
+ */
+int evwait(int wantinput)
+{
+    struct epoll_event ev, evs[MAXEVENTS];
+    int i, n, fd, ready = wantinput && !inpoll;
+
+    if (wantinput && inpoll && !inarmed) {
+	ev.events = EPOLLIN | EPOLLONESHOT;
+	ev.data.fd = infd;
+	if (epoll_ctl(epfd, EPOLL_CTL_MOD, infd, &ev) < 0)
+	    unix_error("epoll_ctl error");
+	inarmed = 1;
+    }
+
+    if ((n = epoll_wait(epfd, evs, MAXEVENTS, ready ? 0 : -1)) < 0) {
+	if (errno != EINTR)
+	    unix_error("epoll_wait error");
+	return ready;
+    }
+    for (i = 0; i < n; i++) {
+	fd = evs[i].data.fd;
+	if (fd == sigfd) {
+	    drainsignals();
+	} else if (fd == infd) {
+	    inarmed = 0;
+	    ready = 1;
+	} else {
+	    /* A child exited; its pidfd has done its job */
+	    epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+	    close(fd);
+	    evhandler(SIGCHLD);
+	}
+    }
+    return ready && wantinput;
+}
@@ -0,0 +1,12 @@
+#ifndef _EVLOOP_H_
+#define _EVLOOP_H_
+
+#include <signal.h>
+#include <sys/types.h>
+#include "util.h"
+
+void evinit(const sigset_t *sigs, handler_t *handler, int fd);
+void evwatchpid(pid_t pid);
+int evwait(int wantinput);
+
+#endif
@@ -0,0 +1,562 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <ctype.h>
+#include <limits.h>
+#include <signal.h>
+#include <inttypes.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include "fastcmd.h"
+#include "vars.h"
+
+/*
+ * Scripts mostly run echo and test, and forking and exec'ing the
+ * program costs far more than the work itself. With msh -b the shell
+ * does that work in-process instead, for the programs it knows:
+ * echo, printf, true, false, test, [, pwd and sleep from GNU coreutils
+ * in /bin or /usr/bin. Each follows its program byte for byte on the
+ * common cases and declines the rest (--help, POSIXLY_CORRECT and
+ * anything the program would print a diagnostic for), so nothing
+ * the program would have said is lost.
+ */
+
+static int (*napper)(double secs);  /* does sleep's waiting, see fastinit */
+
+
+/* helpopt - Is the one argument --help or --version? */
+static int helpopt(char **argv)
+{
+    return argv[1] != NULL && argv[2] == NULL
+	&& (!strcmp(argv[1], "--help") || !strcmp(argv[1], "--version"));
+}
+
+static int isodigit(int c)
+{
+    return c >= '0' && c <= '7';
+}
+
+static int hexval(int c)
+{
+    return isdigit(c) ? c - '0' : tolower(c) - 'a' + 10;
+}
+
+/* fasttrue, fastfalse - true and false ignore their arguments */
+static int fasttrue(char **argv)
+{
+    return helpopt(argv) ? FAST_DECLINE : 0;
+}
+
+static int fastfalse(char **argv)
+{
+    return helpopt(argv) ? FAST_DECLINE : 1;
+}
+
+/*
+ * echoesc - Print s, interpreting the backslash escapes of echo -e.
+ *     Returns 0 if \c cut the output short, 1 otherwise.
+ */
+static int echoesc(const char *s)
+{
+    int c;
+
+    while ((c = (unsigned char) *s++) != '\0') {
+	if (c == '\\' && *s != '\0') {
+	    switch (c = (unsigned char) *s++) {
+	    case 'a': c = '\a'; break;
+	    case 'b': c = '\b'; break;
+	    case 'c': return 0;
+	    case 'e': c = '\033'; break;
+	    case 'f': c = '\f'; break;
+	    case 'n': c = '\n'; break;
+	    case 'r': c = '\r'; break;
+	    case 't': c = '\t'; break;
+	    case 'v': c = '\v'; break;
+	    case 'x':
+		if (!isxdigit((unsigned char) *s)) {
+		    putchar('\\');      /* not an escape; print it as is */
+		    break;
+		}
+		c = hexval(*s++);
+		if (isxdigit((unsigned char) *s))
+		    c = c * 16 + hexval(*s++);
+		break;
+	    case '0':
+		c = 0;
+		if (!isodigit(*s))
+		    break;
+		c = *s++;
+		/* FALLTHROUGH */
+	    case '1': case '2': case '3':
+	    case '4': case '5': case '6': case '7':
+		c -= '0';
+		if (isodigit(*s))
+		    c = c * 8 + (*s++ - '0');
+		if (isodigit(*s))
+		    c = c * 8 + (*s++ - '0');
+		break;
+	    case '\\':
+		break;
+	    default:
+		putchar('\\');
+		break;
+	    }
+	}
+	putchar(c);
+    }
+    return 1;
+}
+
+/*
+ * fastecho - echo [-neE] [words]. Options are leading words made up
+ *     only of n, e and E; the first other word starts the output.
+ */
+static int fastecho(char **argv)
+{
+    int newline = 1, escapes = 0;
+    char **a, *p;
+
+    if (helpopt(argv))
+	return FAST_DECLINE;
+    for (a = argv + 1; *a != NULL && (*a)[0] == '-' && (*a)[1] != '\0'; a++) {
+	for (p = *a + 1; *p != '\0' && strchr("neE", *p) != NULL; p++)
+	    ;
+	if (*p != '\0')
+	    break;
+	for (p = *a + 1; *p != '\0'; p++) {
+	    if (*p == 'n')
+		newline = 0;
+	    else
+		escapes = *p == 'e';
+	}
+    }
+
+    for (; *a != NULL; a++) {
+	if (!escapes)
+	    fputs(*a, stdout);
+	else if (!echoesc(*a))
+	    return 0;
+	if (a[1] != NULL)
+	    putchar(' ');
+    }
+    if (newline)
+	putchar('\n');
+    return 0;
+}
+
+/*
+ * printfesc - Print the escape that follows a backslash at s in a
+ *     printf format. Returns how many characters after the backslash
+ *     it used, or FAST_DECLINE; sets *stop for \c, which ends printf.
+ */
+static int printfesc(FILE *fp, const char *s, int *stop)
+{
+    static const char from[] = "\"\\abefnrtv";
+    static const char to[] = "\"\\\a\b\033\f\n\r\t\v";
+    const char *p = s;
+    int c, n;
+
+    if (*p == 'x') {
+	for (c = 0, n = 0, p++; n < 2 && isxdigit((unsigned char) *p); n++)
+	    c = c * 16 + hexval(*p++);
+	if (n == 0)
+	    return FAST_DECLINE;
+	putc(c, fp);
+    } else if (isodigit(*p)) {
+	for (c = 0, n = 0; n < 3 && isodigit(*p); n++)
+	    c = c * 8 + (*p++ - '0');
+	putc(c, fp);
+    } else if (*p == 'c') {
+	*stop = 1;
+    } else if (*p != '\0' && strchr(from, *p) != NULL) {
+	putc(to[strchr(from, *p++) - from], fp);
+    } else if (*p == 'u' || *p == 'U') {
+	return FAST_DECLINE;
+    } else {
+	putc('\\', fp);
+	if (*p != '\0')
+	    putc(*p++, fp);
+    }
+    return p - s;
+}
+
+/*
+ * numarg - Read a numeric printf argument: a number in C syntax, or a
+ *     quote followed by one character, which stands for its code.
+ *     Returns -1 if printf would complain about it.
+ */
+static int numarg(const char *s, int isSigned, intmax_t *v)
+{
+    char *end;
+
+    if ((*s == '\'' || *s == '"') && s[1] != '\0') {
+	if (s[2] != '\0' || (unsigned char) s[1] >= 0x80)
+	    return -1;
+	*v = (unsigned char) s[1];
+	return 0;
+    }
+    errno = 0;
+    if (isSigned)
+	*v = strtoimax(s, &end, 0);
+    else
+	*v = (intmax_t) strtoumax(s, &end, 0);
+    return errno != 0 || *end != '\0' ? -1 : 0;
+}
+
+/*
+ * fastprintf - printf format [arguments]. The format is used again
+ *     while arguments are left. Takes flags, width and precision with
+ *     %s, %c, %d, %i, %o, %u, %x and %X; any other conversion is left
+ *     to the program. Output is collected first, as a bad argument
+ *     late in the list still means declining.
+ */
+static int fastprintf(char **argv)
+{
+    char **args = argv + 2, spec[32], *buf;
+    const char *f, *arg;
+    size_t len, n;
+    intmax_t v;
+    FILE *fp;
+    int k, used, stop = 0, ret = 0;
+
+    if (argv[1] == NULL || argv[1][0] == '-')
+	return FAST_DECLINE;
+    if ((fp = open_memstream(&buf, &len)) == NULL)
+	return FAST_DECLINE;
+
+    do {
+	used = 0;
+	for (f = argv[1]; ret == 0 && !stop && *f != '\0'; f++) {
+	    if (*f == '\\') {
+		if ((k = printfesc(fp, f + 1, &stop)) < 0)
+		    ret = FAST_DECLINE;
+		else
+		    f += k;
+		continue;
+	    }
+	    if (*f != '%') {
+		putc(*f, fp);
+		continue;
+	    }
+	    if (*++f == '%') {
+		putc('%', fp);
+		continue;
+	    }
+
+	    /* Copy flags, width and precision into spec */
+	    n = strspn(f, "-+ #0");
+	    n += strspn(f + n, "0123456789");
+	    if (f[n] == '.')
+		n += 1 + strspn(f + n + 1, "0123456789");
+	    if (n + 4 > sizeof(spec) || strchr("sciduoxX", f[n]) == NULL
+		|| f[n] == '\0') {
+		ret = FAST_DECLINE;
+		break;
+	    }
+	    spec[0] = '%';
+	    memcpy(spec + 1, f, n);
+	    f += n;
+	    arg = "";
+	    if (*args != NULL) {
+		arg = *args++;
+		used++;
+	    }
+
+	    switch (*f) {
+	    case 's':
+		strcpy(spec + 1 + n, "s");
+		fprintf(fp, spec, arg);
+		break;
+	    case 'c':
+		strcpy(spec + 1 + n, "c");
+		fprintf(fp, spec, *arg);
+		break;
+	    default:
+		if (numarg(arg, *f == 'd' || *f == 'i', &v) < 0) {
+		    ret = FAST_DECLINE;
+		    break;
+		}
+		spec[1 + n] = 'j';
+		spec[2 + n] = *f;
+		spec[3 + n] = '\0';
+		if (*f == 'd' || *f == 'i')
+		    fprintf(fp, spec, v);
+		else
+		    fprintf(fp, spec, (uintmax_t) v);
+	    }
+	}
+    } while (ret == 0 && !stop && used > 0 && *args != NULL);
+
+    /* Arguments no conversion took get a warning from the program */
+    if (ret == 0 && !stop && *args != NULL)
+	ret = FAST_DECLINE;
+    fclose(fp);
+    if (ret == 0)
+	fwrite(buf, 1, len, stdout);
+    free(buf);
+    return ret;
+}
+
+/*
+ * intarg - Read an integer operand of test: blanks, an optional sign,
+ *     digits and blanks. Returns -1 if test would complain about it.
+ */
+static int intarg(const char *s, long long *v)
+{
+    const char *p = s;
+
+    while (*p == ' ' || *p == '\t')
+	p++;
+    if (*p == '-' || *p == '+')
+	p++;
+    if (!isdigit((unsigned char) *p))
+	return -1;
+    while (isdigit((unsigned char) *p))
+	p++;
+    while (*p == ' ' || *p == '\t')
+	p++;
+    if (*p != '\0')
+	return -1;
+    errno = 0;
+    *v = strtoll(s, NULL, 10);
+    return errno != 0 ? -1 : 0;
+}
+
+/*
+ * testunary - Apply the unary test operator op to arg. This and the
+ *     other test helpers return 1 for true, 0 for false and
+ *     FAST_DECLINE for what they leave to the program.
+ */
+static int testunary(const char *op, const char *arg)
+{
+    struct stat st;
+    long long fd;
+
+    switch (op[1]) {
+    case 'n': return *arg != '\0';
+    case 'z': return *arg == '\0';
+    case 'r': return faccessat(AT_FDCWD, arg, R_OK, AT_EACCESS) == 0;
+    case 'w': return faccessat(AT_FDCWD, arg, W_OK, AT_EACCESS) == 0;
+    case 'x': return faccessat(AT_FDCWD, arg, X_OK, AT_EACCESS) == 0;
+    case 'L':
+    case 'h': return lstat(arg, &st) == 0 && S_ISLNK(st.st_mode);
+    case 't':
+	/* The shell's other descriptors are close-on-exec */
+	if (intarg(arg, &fd) < 0 || fd > STDERR_FILENO)
+	    return FAST_DECLINE;
+	return fd >= 0 && isatty(fd);
+    }
+
+    if (strchr("efdbcpSsguk", op[1]) == NULL)
+	return FAST_DECLINE;
+    if (stat(arg, &st) < 0)
+	return 0;
+    switch (op[1]) {
+    case 'f': return S_ISREG(st.st_mode);
+    case 'd': return S_ISDIR(st.st_mode);
+    case 'b': return S_ISBLK(st.st_mode);
+    case 'c': return S_ISCHR(st.st_mode);
+    case 'p': return S_ISFIFO(st.st_mode);
+    case 'S': return S_ISSOCK(st.st_mode);
+    case 's': return st.st_size > 0;
+    case 'g': return (st.st_mode & S_ISGID) != 0;
+    case 'u': return (st.st_mode & S_ISUID) != 0;
+    case 'k': return (st.st_mode & S_ISVTX) != 0;
+    }
+    return 1;               /* -e */
+}
+
+static const char *intops[] = { "-eq", "-ne", "-lt", "-le", "-gt", "-ge" };
+
+/* testop - Which integer comparison op is, 6 if none */
+static int testop(const char *op)
+{
+    int i;
+
+    for (i = 0; i < 6 && strcmp(op, intops[i]); i++)
+	;
+    return i;
+}
+
+/* testbinary - Apply the string or integer comparison op */
+static int testbinary(const char *a, const char *op, const char *b)
+{
+    long long x, y;
+
+    if (!strcmp(op, "=") || !strcmp(op, "=="))
+	return strcmp(a, b) == 0;
+    if (!strcmp(op, "!="))
+	return strcmp(a, b) != 0;
+    if (intarg(a, &x) < 0 || intarg(b, &y) < 0)
+	return FAST_DECLINE;
+    switch (testop(op)) {
+    case 0: return x == y;
+    case 1: return x != y;
+    case 2: return x < y;
+    case 3: return x <= y;
+    case 4: return x > y;
+    }
+    return x >= y;
+}
+
+/* testnot - Negate a test result, passing FAST_DECLINE through */
+static int testnot(int v)
+{
+    return v < 0 ? v : !v;
+}
+
+/*
+ * testargs - Evaluate the n operands at a the way POSIX says test must
+ *     for up to four: by their number first, then by what they are.
+ *     Longer expressions, -a, -o and file comparisons are left to the
+ *     program.
+ */
+static int testargs(char **a, int n)
+{
+    switch (n) {
+    case 0:
+	return 0;
+    case 1:
+	return a[0][0] != '\0';
+    case 2:
+	if (!strcmp(a[0], "!"))
+	    return testnot(testargs(a + 1, 1));
+	if (a[0][0] == '-' && a[0][1] != '\0' && a[0][2] == '\0')
+	    return testunary(a[0], a[1]);
+	return FAST_DECLINE;
+    case 3:
+	if (!strcmp(a[1], "=") || !strcmp(a[1], "==") || !strcmp(a[1], "!=")
+	    || testop(a[1]) < 6)
+	    return testbinary(a[0], a[1], a[2]);
+	if (!strcmp(a[1], "-a") || !strcmp(a[1], "-o") || !strcmp(a[1], "<")
+	    || !strcmp(a[1], ">") || !strcmp(a[1], "-nt")
+	    || !strcmp(a[1], "-ot") || !strcmp(a[1], "-ef"))
+	    return FAST_DECLINE;
+	if (!strcmp(a[0], "!"))
+	    return testnot(testargs(a + 1, 2));
+	if (!strcmp(a[0], "(") && !strcmp(a[2], ")"))
+	    return testargs(a + 1, 1);
+	return FAST_DECLINE;
+    case 4:
+	if (!strcmp(a[0], "!"))
+	    return testnot(testargs(a + 1, 3));
+	if (!strcmp(a[0], "(") && !strcmp(a[3], ")"))
+	    return testargs(a + 1, 2);
+	return FAST_DECLINE;
+    }
+    return FAST_DECLINE;
+}
+
+/*
+ * fasttest - test and [. Exit status 0 is true and 1 is false; [ also
+ *     wants ] as its last word.
+ */
+static int fasttest(char **argv)
+{
+    const char *name = strrchr(argv[0], '/');
+    int n, v;
+
+    for (n = 0; argv[n + 1] != NULL; n++)
+	;
+    if (!strcmp(name != NULL ? name + 1 : argv[0], "[")) {
+	if (helpopt(argv) || n == 0 || strcmp(argv[n], "]"))
+	    return FAST_DECLINE;
+	n--;
+    }
+    v = testargs(argv + 1, n);
+    return v < 0 ? v : !v;
+}
+
+/* fastpwd - pwd with no options prints the physical directory */
+static int fastpwd(char **argv)
+{
+    char dir[PATH_MAX];
+
+    if (argv[1] != NULL || getcwd(dir, sizeof(dir)) == NULL)
+	return FAST_DECLINE;
+    puts(dir);
+    return 0;
+}
+
+/*
+ * fastsleep - sleep for the sum of its arguments, each a number of
+ *     seconds with an optional s, m, h or d suffix. The shell does the
+ *     waiting, so a ctrl-c can cut it short with the status a program
+ *     killed by SIGINT would leave.
+ */
+static int fastsleep(char **argv)
+{
+    double secs = 0, t;
+    char **a, *end;
+    int sig;
+
+    if (argv[1] == NULL || napper == NULL)
+	return FAST_DECLINE;
+    for (a = argv + 1; *a != NULL; a++) {
+	if (!isdigit((unsigned char) **a) && **a != '.')
+	    return FAST_DECLINE;
+	t = strtod(*a, &end);
+	if (end == *a || (*end != '\0' && end[1] != '\0'))
+	    return FAST_DECLINE;
+	switch (*end) {
+	case 'd': t *= 24;  /* FALLTHROUGH */
+	case 'h': t *= 60;  /* FALLTHROUGH */
+	case 'm': t *= 60;  /* FALLTHROUGH */
+	case 's':
+	case '\0':
+	    break;
+	default:
+	    return FAST_DECLINE;
+	}
+	secs += t;
+    }
+    if (secs > INT_MAX)
+	return FAST_DECLINE;
+    sig = napper(secs);
+    return sig ? 128 + sig : 0;
+}
+
+static const struct {
+    const char *name;
+    fastcmd_t *run;
+} fastcmds[] = {
+    { "echo", fastecho }, { "printf", fastprintf }, { "true", fasttrue },
+    { "false", fastfalse }, { "test", fasttest }, { "[", fasttest },
+    { "pwd", fastpwd }, { "sleep", fastsleep },
+};
+
+/*
+ * fastinit - Give sleep its way to wait: nap(secs) returns 0 after
+ *     secs seconds, or the signal that interrupted it sooner.
+ */
+void fastinit(int (*nap)(double secs))
+{
+    napper = nap;
+}
+
+/*
+ * fastlookup - The in-process version of the program at path, which
+ *     must be absolute, or NULL if there is none.
+ */
+fastcmd_t *fastlookup(const char *path)
+{
+    const char *name;
+    size_t i;
+
+    if (!strncmp(path, "/usr/bin/", 9))
+	name = path + 9;
+    else if (!strncmp(path, "/bin/", 5))
+	name = path + 5;
+    else
+	return NULL;
+
+    for (i = 0; i < sizeof(fastcmds) / sizeof(fastcmds[0]); i++)
+	if (!strcmp(name, fastcmds[i].name))
+	    break;
+    if (i == sizeof(fastcmds) / sizeof(fastcmds[0])
+	|| getvar("POSIXLY_CORRECT") != NULL || access(path, X_OK) < 0)
+	return NULL;
+    return fastcmds[i].run;
+}
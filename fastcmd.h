@@ -0,0 +1,17 @@
+#ifndef _FASTCMD_H_
+#define _FASTCMD_H_
+
+/*
+ * In-process versions of small programs (msh -b). Each one returns the
+ * exit status the program would have, or FAST_DECLINE, before writing
+ * anything, when it would not produce exactly the program's output;
+ * the program is then run as usual.
+ */
+#define FAST_DECLINE -1
+
+typedef int fastcmd_t(char **argv);
+
+void fastinit(int (*nap)(double secs));
+fastcmd_t *fastlookup(const char *path);
+
+#endif
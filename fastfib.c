@@ -0,0 +1,445 @@
+/*
+ * fastfib.c - Fibonacci numbers without a process per call
+ *
+ * usage: fastfib [-s memo|iter|double|par] [-j <procs>] <n>
+ *        fastfib -b [-f <fib>] [-j <procs>] <n>
+ * Prints F(n) using the chosen strategy (default double):
+ *   memo    top-down recursion over a table of the values seen so far
+ *   iter    bottom-up, two values at a time, O(n) additions
+ *   double  fast doubling, O(log n) multiplications:
+ *           F(2k) = F(k)(2F(k+1) - F(k)), F(2k+1) = F(k)^2 + F(k+1)^2
+ *   par     the same call tree as fib.c, but only the top of it is
+ *           split across at most <procs> processes (default: one per
+ *           core) and each process walks its subtrees serially
+ * memo, iter and double work on arbitrarily large numbers; par is
+ * limited to 64 bits, since its work grows as F(n) anyway.
+ *
+ * With -b, runs the fork tree in <fib> (default ./fib) for n and then
+ * each strategy, and prints the wall time and processes used by each.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <stdint.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <fcntl.h>
+#include "util.h"
+
+#define BASE     1000000000u   /* each limb holds 9 decimal digits */
+#define MAXFIB64 93            /* largest n with F(n) in 64 bits */
+#define MEMOMAX  20000         /* memo recursion is n calls deep */
+
+struct big_t {                 /* A non-negative big integer */
+    int n;                     /* limbs in use; 0 means zero */
+    int size;                  /* limbs allocated */
+    uint32_t *d;               /* limbs, least significant first */
+};
+
+static int nprocs = 1;         /* processes used by the last strategy */
+
+
+/* bigroom - Make room for n limbs in a */
+static void bigroom(struct big_t *a, int n)
+{
+    uint32_t *d;
+
+    if (n <= a->size)
+	return;
+    if ((d = realloc(a->d, n * sizeof(uint32_t))) == NULL)
+	unix_error("realloc error");
+    a->d = d;
+    a->size = n;
+}
+
+/* bigset - Set a to the small value v */
+static void bigset(struct big_t *a, uint32_t v)
+{
+    bigroom(a, 1);
+    a->d[0] = v;
+    a->n = v != 0;
+}
+
+/* bigcopy - Set r to a */
+static void bigcopy(struct big_t *r, const struct big_t *a)
+{
+    bigroom(r, a->n);
+    memcpy(r->d, a->d, a->n * sizeof(uint32_t));
+    r->n = a->n;
+}
+
+/* bigadd - Set r to a + b; r may be a or b */
+static void bigadd(struct big_t *r, const struct big_t *a,
+		   const struct big_t *b)
+{
+    int i, n = a->n > b->n ? a->n : b->n;
+    uint32_t carry = 0, s;
+
+    bigroom(r, n + 1);
+    for (i = 0; i < n; i++) {
+	s = carry + (i < a->n ? a->d[i] : 0) + (i < b->n ? b->d[i] : 0);
+	carry = s >= BASE;
+	r->d[i] = carry ? s - BASE : s;
+    }
+    if (carry)
+	r->d[n++] = carry;
+    r->n = n;
+}
+
+/* bigsub - Set r to a - b, where a >= b; r may be a */
+static void bigsub(struct big_t *r, const struct big_t *a,
+		   const struct big_t *b)
+{
+    int i;
+    int64_t s, borrow = 0;
+
+    bigroom(r, a->n);
+    for (i = 0; i < a->n; i++) {
+	s = (int64_t) a->d[i] - borrow - (i < b->n ? b->d[i] : 0);
+	borrow = s < 0;
+	r->d[i] = borrow ? s + BASE : s;
+    }
+    r->n = a->n;
+    while (r->n > 0 && r->d[r->n - 1] == 0)
+	r->n--;
+}
+
+/* bigmul - Set r to a * b; r must be neither a nor b */
+static void bigmul(struct big_t *r, const struct big_t *a,
+		   const struct big_t *b)
+{
+    int i, j;
+    uint64_t t, carry;
+
+    if (a->n == 0 || b->n == 0) {
+	r->n = 0;
+	return;
+    }
+    bigroom(r, a->n + b->n);
+    memset(r->d, 0, (a->n + b->n) * sizeof(uint32_t));
+    for (i = 0; i < a->n; i++) {
+	carry = 0;
+	for (j = 0; j < b->n; j++) {
+	    t = (uint64_t) a->d[i] * b->d[j] + r->d[i + j] + carry;
+	    r->d[i + j] = t % BASE;
+	    carry = t / BASE;
+	}
+	r->d[i + b->n] = carry;
+    }
+    r->n = a->n + b->n;
+    while (r->n > 0 && r->d[r->n - 1] == 0)
+	r->n--;
+}
+
+/* bigprint - Print a in decimal */
+static void bigprint(const struct big_t *a)
+{
+    int i;
+
+    if (a->n == 0) {
+	printf("0\n");
+	return;
+    }
+    printf("%u", a->d[a->n - 1]);
+    for (i = a->n - 2; i >= 0; i--)
+	printf("%09u", a->d[i]);
+    printf("\n");
+}
+
+/* fibiter - Set r to F(n) by adding up from F(0) and F(1) */
+static void fibiter(struct big_t *r, int n)
+{
+    struct big_t a = { 0 }, b = { 0 }, t;
+
+    bigset(&a, 0);
+    bigset(&b, 1);
+    while (n-- > 0) {
+	bigadd(&a, &a, &b);     /* (a, b) = (b, a + b) */
+	t = a;
+	a = b;
+	b = t;
+    }
+    bigcopy(r, &a);
+    free(a.d);
+    free(b.d);
+}
+
+/* memofib - F(n) from memo, computing and storing what is missing */
+static struct big_t *memofib(struct big_t *memo, int *known, int n)
+{
+    if (!known[n]) {
+	bigadd(&memo[n], memofib(memo, known, n - 1),
+	       memofib(memo, known, n - 2));
+	known[n] = 1;
+    }
+    return &memo[n];
+}
+
+/* fibmemo - Set r to F(n) by memoized recursion */
+static void fibmemo(struct big_t *r, int n)
+{
+    struct big_t *memo;
+    int i, *known;
+
+    memo = calloc(n + 2, sizeof(*memo));
+    known = calloc(n + 2, sizeof(int));
+    if (memo == NULL || known == NULL)
+	unix_error("calloc error");
+    bigset(&memo[0], 0);
+    bigset(&memo[1], 1);
+    known[0] = known[1] = 1;
+    bigcopy(r, memofib(memo, known, n));
+    for (i = 0; i <= n + 1; i++)
+	free(memo[i].d);
+    free(memo);
+    free(known);
+}
+
+/*
+ * fibdouble - Set r to F(n) by fast doubling, walking the bits of n
+ *     from the top with (a, b) = (F(k), F(k+1)).
+ */
+static void fibdouble(struct big_t *r, int n)
+{
+    struct big_t a = { 0 }, b = { 0 }, c = { 0 }, d = { 0 }, t = { 0 };
+    int bit;
+
+    bigset(&a, 0);
+    bigset(&b, 1);
+    for (bit = 30; bit >= 0; bit--) {
+	if ((n >> bit) == 0)
+	    continue;
+	bigadd(&t, &b, &b);     /* c = a * (2b - a) */
+	bigsub(&t, &t, &a);
+	bigmul(&c, &a, &t);
+	bigmul(&d, &a, &a);     /* d = a^2 + b^2 */
+	bigmul(&t, &b, &b);
+	bigadd(&d, &d, &t);
+	if ((n >> bit) & 1) {   /* k = 2k + 1 */
+	    bigcopy(&a, &d);
+	    bigadd(&b, &c, &d);
+	} else {                /* k = 2k */
+	    bigcopy(&a, &c);
+	    bigcopy(&b, &d);
+	}
+    }
+    bigcopy(r, &a);
+    free(a.d);
+    free(b.d);
+    free(c.d);
+    free(d.d);
+    free(t.d);
+}
+
+/* fibtree - F(n) by the plain two-way recursion, in this process */
+static uint64_t fibtree(int n)
+{
+    return n < 2 ? n : fibtree(n - 1) + fibtree(n - 2);
+}
+
+/*
+ * parfib - F(n) by the two-way recursion, using at most budget
+ *     processes including this one. The F(n-1) subtree goes to a
+ *     child with half the budget, which writes its result to a pipe;
+ *     this process takes F(n-2) with the rest.
+ */
+static uint64_t parfib(int n, int budget)
+{
+    uint64_t mine, theirs;
+    int fds[2], status;
+    pid_t pid;
+
+    if (budget < 2 || n < 2)
+	return fibtree(n);
+    if (pipe(fds) < 0)
+	unix_error("pipe error");
+    if ((pid = fork()) < 0)
+	unix_error("fork error");
+    if (pid == 0) {
+	close(fds[0]);
+	theirs = parfib(n - 1, budget / 2);
+	if (write(fds[1], &theirs, sizeof(theirs)) != sizeof(theirs))
+	    _exit(1);
+	_exit(0);
+    }
+    close(fds[1]);
+    mine = parfib(n - 2, budget - budget / 2);
+    if (read(fds[0], &theirs, sizeof(theirs)) != sizeof(theirs))
+	app_error("parfib: child gave no result");
+    close(fds[0]);
+    if (waitpid(pid, &status, 0) < 0)
+	unix_error("waitpid error");
+    return mine + theirs;
+}
+
+/*
+ * forkprocs - How many processes parfib(n, budget) uses, counting
+ *     the caller
+ */
+static int forkprocs(int n, int budget)
+{
+    if (budget < 2 || n < 2)
+	return 1;
+    return forkprocs(n - 1, budget / 2) + forkprocs(n - 2, budget - budget / 2);
+}
+
+/*
+ * treeprocs - How many processes fib.c's doFib(n) uses: one per call,
+ *     each forking two more unless n < 2
+ */
+static long treeprocs(int n)
+{
+    return n < 2 ? 1 : 1 + treeprocs(n - 1) + treeprocs(n - 2);
+}
+
+/* now - Monotonic clock in seconds */
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * compute - Set r to F(n) with strategy s, recording in nprocs how
+ *     many processes it took. Returns -1 if s cannot do n.
+ */
+static int compute(struct big_t *r, const char *s, int n, int jobs)
+{
+    uint64_t v;
+
+    nprocs = 1;
+    if (strcmp(s, "memo") == 0) {
+	if (n > MEMOMAX)
+	    return -1;
+	fibmemo(r, n);
+    } else if (strcmp(s, "iter") == 0) {
+	fibiter(r, n);
+    } else if (strcmp(s, "double") == 0) {
+	fibdouble(r, n);
+    } else if (strcmp(s, "par") == 0) {
+	if (n > MAXFIB64)
+	    return -1;
+	v = parfib(n, jobs);
+	nprocs = forkprocs(n, jobs);
+	bigset(r, v % BASE);
+	if (v >= BASE) {        /* F(93) needs three limbs */
+	    bigroom(r, 3);
+	    r->d[1] = (v / BASE) % BASE;
+	    r->d[2] = v / BASE / BASE;
+	    r->n = r->d[2] ? 3 : 2;
+	}
+    } else {
+	return -1;
+    }
+    return 0;
+}
+
+/*
+ * runtree - Time fib.c's fork tree for n by running prog, throwing
+ *     away what it prints. fib hands its result back as its exit
+ *     status, so any exit but its usage error (-1) counts. Returns
+ *     the wall time, or -1 if it could not be run.
+ */
+static double runtree(const char *prog, int n)
+{
+    char arg[16];
+    int status, fd;
+    pid_t pid;
+    double start = now();
+
+    snprintf(arg, sizeof(arg), "%d", n);
+    if (access(prog, X_OK) < 0)
+	return -1;
+    if ((pid = fork()) < 0)
+	unix_error("fork error");
+    if (pid == 0) {
+	if ((fd = open("/dev/null", O_WRONLY)) >= 0)
+	    dup2(fd, STDOUT_FILENO);
+	execl(prog, prog, arg, (char *) NULL);
+	_exit(127);
+    }
+    if (waitpid(pid, &status, 0) < 0)
+	unix_error("waitpid error");
+    if (!WIFEXITED(status) || WEXITSTATUS(status) == 255)
+	return -1;
+    return now() - start;
+}
+
+/* bench - Compare the fork tree in prog with each strategy for n */
+static void bench(const char *prog, int n, int jobs)
+{
+    static char *strategies[] = { "memo", "iter", "double", "par", NULL };
+    struct big_t r = { 0 };
+    char **s;
+    double t;
+
+    printf("%-8s %12s %10s\n", "strategy", "seconds", "processes");
+    if ((t = runtree(prog, n)) < 0)
+	printf("%-8s %12s %10ld\n", "fork", "failed", treeprocs(n));
+    else
+	printf("%-8s %12.6f %10ld\n", "fork", t, treeprocs(n));
+    for (s = strategies; *s != NULL; s++) {
+	t = now();
+	if (compute(&r, *s, n, jobs) < 0) {
+	    printf("%-8s %12s\n", *s, "n/a");
+	    continue;
+	}
+	printf("%-8s %12.6f %10d\n", *s, now() - t, nprocs);
+    }
+    free(r.d);
+}
+
+int main(int argc, char **argv)
+{
+    int c, n, jobs, dobench = 0;
+    char *strategy = "double", *prog = "./fib";
+    struct big_t r = { 0 };
+
+    if ((jobs = sysconf(_SC_NPROCESSORS_ONLN)) < 1)
+	jobs = 1;
+    while ((c = getopt(argc, argv, "s:j:bf:")) != EOF) {
+	switch (c) {
+	case 's':
+	    strategy = optarg;
+	    break;
+	case 'j':
+	    jobs = atoi(optarg);
+	    break;
+	case 'b':
+	    dobench = 1;
+	    break;
+	case 'f':
+	    prog = optarg;
+	    break;
+	default:
+	    optind = argc;
+	}
+    }
+    if (optind != argc - 1 || jobs < 1) {
+	fprintf(stderr, "Usage: %s [-s memo|iter|double|par] [-j <procs>] <n>\n"
+		"       %s -b [-f <fib>] [-j <procs>] <n>\n", argv[0], argv[0]);
+	exit(1);
+    }
+    if ((n = atoi(argv[optind])) < 0) {
+	fprintf(stderr, "number must not be negative\n");
+	exit(1);
+    }
+
+    if (dobench) {
+	bench(prog, n, jobs);
+	exit(0);
+    }
+    if (compute(&r, strategy, n, jobs) < 0) {
+	fprintf(stderr, "%s: no such strategy, or n too large for it\n",
+		strategy);
+	exit(1);
+    }
+    bigprint(&r);
+    free(r.d);
+    exit(0);
+}
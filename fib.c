@@ -7,10 +7,21 @@
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <errno.h>
+#include <stdint.h>
+#include <sys/mman.h>
 
 const int MAX = 13;
+/* Largest n whose result fits in 64 bits. Pipe mode only forks while
+ * its budget lasts and computes the rest with the linear serialFib,
+ * so this, not the running time, is what bounds n */
+const int PIPEMAX = 93;
 
 static void doFib(int n, int doPrint);
+static uint64_t pipeFib(int n);
+
+/* Settings and shared state for pipe mode (-p) */
+static int cutoff = 2;        /* below this n, compute without forking */
+static long *forksLeft;       /* fork budget shared by the whole tree */
 
 
 /*
@@ -25,20 +36,52 @@ inline static void unix_error(char *msg)
 
 int main(int argc, char **argv)
 {
-    int arg;
+    int arg, c;
     int print=1;
+    int pipeMode = 0;
+    long budget = 1000;
 
-    if(argc != 2){
-        fprintf(stderr, "Usage: fib <num>\n");
+    while((c = getopt(argc, argv, "pc:b:")) != EOF) {
+        switch(c) {
+        case 'p':             /* return results through pipes */
+            pipeMode = 1;
+            break;
+        case 'c':             /* serial cutoff */
+            cutoff = atoi(optarg);
+            break;
+        case 'b':             /* fork budget */
+            budget = atol(optarg);
+            break;
+        default:
+            optind = argc;
+        }
+    }
+    if(optind != argc - 1){
+        fprintf(stderr, "Usage: fib [-p [-c cutoff] [-b budget]] <num>\n");
         exit(-1);
     }
 
-    arg = atoi(argv[1]);
-    if(arg < 0 || arg > MAX){
-        fprintf(stderr, "number must be between 0 and %d\n", MAX);
+    arg = atoi(argv[optind]);
+    if(arg < 0 || arg > (pipeMode ? PIPEMAX : MAX)){
+        fprintf(stderr, "number must be between 0 and %d\n",
+                pipeMode ? PIPEMAX : MAX);
         exit(-1);
     }
 
+    if(pipeMode) {
+        /* The budget lives in a shared page so every process in the
+        * tree draws from the same count.
+        */
+        forksLeft = mmap(NULL, sizeof(*forksLeft), PROT_READ | PROT_WRITE,
+                         MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+        if(forksLeft == MAP_FAILED) {
+            unix_error("mmap error");
+        }
+        *forksLeft = budget;
+        printf("%llu\n", (unsigned long long) pipeFib(arg));
+        return 0;
+    }
+
     doFib(arg, print);
 
     return 0;
@@ -142,3 +185,97 @@ static void doFib(int n, int doPrint)
 }
 
 
+
+/*
+ * serialFib - F(n) without forking. Iterative, since pipe mode falls
+ *    back to it for whole subtrees once the fork budget is spent, and
+ *    the recursion would take exponential time for n near PIPEMAX
+ */
+static uint64_t serialFib(int n)
+{
+    uint64_t a = 0, b = 1, t;
+
+    while(n-- > 0) {
+        t = a + b;
+        a = b;
+        b = t;
+    }
+    return a;
+}
+
+/*
+ * forkFib - Start a child that computes F(n) and writes it to a pipe,
+ *    storing the pipe's read end in *fd. Returns the child's pid, or
+ *    0 if the fork budget is spent and nothing was started.
+ */
+static pid_t forkFib(int n, int *fd)
+{
+    int fds[2];
+    uint64_t result;
+    pid_t pid;
+
+    if(__atomic_sub_fetch(forksLeft, 1, __ATOMIC_RELAXED) < 0) {
+        return 0;
+    }
+    if(pipe(fds) < 0) {
+        unix_error("pipe error");
+    }
+    if((pid = fork()) < 0) {
+        unix_error("fork error");
+    }
+    if(pid == 0) {
+        close(fds[0]);
+        result = pipeFib(n);
+        if(write(fds[1], &result, sizeof(result)) != sizeof(result)) {
+            _exit(1);
+        }
+        _exit(0);
+    }
+    close(fds[1]);
+    *fd = fds[0];
+    return pid;
+}
+
+/*
+ * readFib - Read the result of the child pid from fd and reap it
+ */
+static uint64_t readFib(pid_t pid, int fd)
+{
+    uint64_t result;
+    int status;
+
+    if(read(fd, &result, sizeof(result)) != sizeof(result)) {
+        fprintf(stderr, "fib: child %d gave no result\n", (int) pid);
+        exit(-1);
+    }
+    close(fd);
+    waitpid(pid, &status, 0);
+    return result;
+}
+
+/*
+ * pipeFib - Compute F(n) like doFib, forking a child for each of the
+ *    two recursive calls, but each child writes its 64-bit result to
+ *    a pipe instead of squeezing it into its exit status. Calls below
+ *    the cutoff, and calls made once the fork budget is spent, are
+ *    computed in this process instead, so large n stays within a
+ *    fixed number of processes.
+ */
+static uint64_t pipeFib(int n)
+{
+    pid_t pid1 = 0, pid2 = 0;
+    int fd1, fd2;
+    uint64_t total = 0;
+
+    if(n < 2 || n < cutoff) {
+        return serialFib(n);
+    }
+
+    /* Start both children before waiting on either, as doFib does */
+    pid1 = forkFib(n - 1, &fd1);
+    pid2 = forkFib(n - 2, &fd2);
+
+    total += pid1 ? readFib(pid1, fd1) : serialFib(n - 1);
+    total += pid2 ? readFib(pid2, fd2) : serialFib(n - 2);
+    return total;
+}
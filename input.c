@@ -0,0 +1,119 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include "util.h"
+#include "input.h"
+
+/*
+ * Command lines are read in chunks of INCHUNK bytes and handed out
+ * where they lie in the buffer, so a script costs one read per chunk
+ * rather than per line and no line is ever copied. To make each line
+ * a C string the byte after its newline is saved and replaced with a
+ * NUL, and put back on the next call. The buffer always has two bytes
+ * to spare past the data, for that NUL and for the newline added to a
+ * last line that has none. A line longer than the buffer doubles it.
+ */
+
+
+/* inopenfd - Read lines from fd */
+void inopenfd(struct input_t *in, int fd)
+{
+    memset(in, 0, sizeof(*in));
+    in->fd = fd;
+    in->saved = -1;
+    in->size = INCHUNK + 2;
+    if ((in->buf = malloc(in->size)) == NULL)
+	unix_error("malloc error");
+}
+
+/* inopenstr - Read lines from the string s, as for msh -c */
+void inopenstr(struct input_t *in, const char *s)
+{
+    memset(in, 0, sizeof(*in));
+    in->fd = -1;
+    in->saved = -1;
+    in->eof = 1;
+    in->len = strlen(s);
+    in->size = in->len + 2;
+    if ((in->buf = malloc(in->size)) == NULL)
+	unix_error("malloc error");
+    memcpy(in->buf, s, in->len);
+}
+
+/*
+ * infill - Read the next chunk into the buffer, first moving the
+ *     partial line at the end of the buffer to its start and growing
+ *     the buffer if that line fills it.
+ */
+static void infill(struct input_t *in)
+{
+    char *buf;
+    ssize_t n;
+
+    memmove(in->buf, in->buf + in->pos, in->len - in->pos);
+    in->len -= in->pos;
+    in->pos = 0;
+    if (in->size - in->len - 2 < INCHUNK / 2) {
+	if ((buf = realloc(in->buf, in->size * 2)) == NULL)
+	    unix_error("realloc error");
+	in->buf = buf;
+	in->size *= 2;
+    }
+
+    if (in->wait != NULL && !in->wait(1))
+	return;
+    if ((n = read(in->fd, in->buf + in->len, in->size - in->len - 2)) < 0) {
+	if (errno != EINTR && errno != EAGAIN)
+	    unix_error("read error");
+    } else if (n == 0) {
+	in->eof = 1;
+    } else {
+	in->len += n;
+    }
+}
+
+/*
+ * inreadline - Return the next line of in, newline and NUL terminated,
+ *     and store its length (with the newline) in *lenp. The line is
+ *     good until the next call. A last line without a newline gets
+ *     one. Returns NULL at end of input.
+ */
+char *inreadline(struct input_t *in, size_t *lenp)
+{
+    char *line, *nl;
+
+    if (in->saved >= 0) {
+	in->buf[in->pos] = in->saved;
+	in->saved = -1;
+    }
+    while (1) {
+	line = in->buf + in->pos;
+	nl = memchr(line, '\n', in->len - in->pos);
+	if (nl == NULL && in->eof && in->pos < in->len) {
+	    in->buf[in->len++] = '\n';
+	    nl = in->buf + in->len - 1;
+	}
+	if (nl != NULL) {
+	    *lenp = nl + 1 - line;
+	    in->pos += *lenp;
+	    in->saved = (unsigned char) in->buf[in->pos];
+	    in->buf[in->pos] = '\0';
+	    return line;
+	}
+	if (in->eof)
+	    return NULL;
+	infill(in);
+    }
+}
+
+/* inclose - Free the buffer of in and close its descriptor */
+void inclose(struct input_t *in)
+{
+    free(in->buf);
+    in->buf = NULL;
+    if (in->fd >= 0)
+	close(in->fd);
+    in->fd = -1;
+}
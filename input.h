@@ -0,0 +1,25 @@
+#ifndef _INPUT_H_
+#define _INPUT_H_
+
+#include <stddef.h>
+
+#define INCHUNK (1 << 16)   /* bytes asked for by each read */
+
+struct input_t {            /* A source of command lines */
+    int fd;                 /* descriptor lines are read from, -1 if none */
+    char *buf;              /* bytes read and not yet handed out */
+    size_t size;            /* bytes buf can hold */
+    size_t pos;             /* start of the next line */
+    size_t len;             /* end of the bytes read so far */
+    int eof;                /* nothing more will be read */
+    int saved;              /* byte under the last line's NUL, or -1 */
+    int (*wait)(int);       /* called as wait(1) before each read, which
+                               waits only while it returns 0 */
+};
+
+void inopenfd(struct input_t *in, int fd);
+void inopenstr(struct input_t *in, const char *s);
+char *inreadline(struct input_t *in, size_t *lenp);
+void inclose(struct input_t *in);
+
+#endif
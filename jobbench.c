@@ -0,0 +1,329 @@
+/*
+ * jobbench.c - Measure how fast the shell starts and controls jobs
+ *
+ * usage: jobbench [-f <fgjobs>] [-b <bgjobs,...>] [-t <trials>]
+ *                 <shell> [shell args...]
+ * Runs the shell (normally msh -p) on a pair of pipes, the way
+ * sdriver.pl does, and measures:
+ *   fg_spawn_rate     <fgjobs> foreground /bin/true jobs in a row
+ *   bg_spawn_rate     each count in <bgjobs> of background jobs that
+ *                     are all still alive when the last one starts
+ *   tstp_latency      SIGTSTP to the shell until it reports the
+ *                     foreground job stopped
+ *   fg_resume_latency "fg" written to the shell until the stopped
+ *                     job is running again, as seen in /proc
+ * The latencies are measured <trials> times each. Every measurement
+ * is printed on its own CSV line,
+ *     shell,metric,param,trial,value,unit
+ * so runs can be kept and compared as eval, waitfg and the SIGCHLD
+ * handler change.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <signal.h>
+#include <poll.h>
+#include <time.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "util.h"
+
+#define TIMEOUT  30     /* seconds to wait for any one reply */
+#define BGSLEEP  "2"    /* seconds each background job lives */
+
+static pid_t shell;             /* the shell being measured */
+static int tosh, fromsh;        /* its stdin and stdout */
+static char shellname[MAXLINE]; /* command line, as printed in the CSV */
+static char out[1 << 16];       /* shell output not yet matched */
+static int outlen;
+
+
+/* now - Monotonic clock in seconds */
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* csv - Print one measurement */
+static void csv(const char *metric, long param, int trial, double value,
+		const char *unit)
+{
+    printf("%s,%s,%ld,%d,%.9g,%s\n", shellname, metric, param, trial,
+	   value, unit);
+    fflush(stdout);
+}
+
+/*
+ * expect - Write the len bytes at cmds to the shell, reading its output
+ *     all the while so neither side can block the other, until a line
+ *     containing marker has been read. Returns the time that line
+ *     arrived. The matched line and all before it are consumed; a
+ *     copy of the line goes to line if it is not NULL.
+ */
+static double expect(const char *cmds, size_t len, const char *marker,
+		     char *line)
+{
+    struct pollfd pfd[2];
+    double deadline = now() + TIMEOUT;
+    char *hit, *eol;
+    ssize_t n;
+
+    while (1) {
+	out[outlen] = '\0';
+	if ((hit = strstr(out, marker)) != NULL
+	    && (eol = strchr(hit, '\n')) != NULL) {
+	    while (hit > out && hit[-1] != '\n')
+		hit--;
+	    if (line != NULL) {
+		memcpy(line, hit, eol - hit);
+		line[eol - hit] = '\0';
+	    }
+	    outlen -= eol + 1 - out;
+	    memmove(out, eol + 1, outlen);
+	    return now();
+	}
+	if (now() > deadline)
+	    app_error("jobbench: shell stopped answering");
+
+	pfd[0].fd = fromsh;
+	pfd[0].events = POLLIN;
+	pfd[1].fd = tosh;
+	pfd[1].events = len > 0 ? POLLOUT : 0;
+	if (poll(pfd, 2, 100) < 0 && errno != EINTR)
+	    unix_error("poll error");
+	if (pfd[1].revents & POLLOUT) {
+	    if ((n = write(tosh, cmds, len)) < 0)
+		unix_error("write error");
+	    cmds += n;
+	    len -= n;
+	}
+	if (pfd[0].revents & (POLLIN | POLLHUP)) {
+	    /* Keep the tail if the buffer fills with unmatched lines */
+	    if (outlen == sizeof(out) - 1) {
+		outlen /= 2;
+		memmove(out, out + outlen, outlen);
+	    }
+	    if ((n = read(fromsh, out + outlen, sizeof(out) - 1 - outlen)) <= 0)
+		app_error("jobbench: shell exited");
+	    outlen += n;
+	}
+    }
+}
+
+/* writeall - Write a short command without waiting for a reply */
+static void writeall(const char *cmd)
+{
+    if (write(tosh, cmd, strlen(cmd)) != (ssize_t) strlen(cmd))
+	unix_error("write error");
+}
+
+/* send - Write a string of commands and wait for marker */
+static double send(const char *cmds, const char *marker, char *line)
+{
+    return expect(cmds, strlen(cmds), marker, line);
+}
+
+/* procstate - The state letter of pid in /proc, or 0 if it is gone */
+static char procstate(pid_t pid)
+{
+    char path[64], state = 0;
+    FILE *fp;
+
+    snprintf(path, sizeof(path), "/proc/%d/stat", (int) pid);
+    if ((fp = fopen(path, "r")) == NULL)
+	return 0;
+    if (fscanf(fp, "%*d (%*[^)]) %c", &state) != 1)
+	state = 0;
+    fclose(fp);
+    return state;
+}
+
+/*
+ * untilstate - Poll pid every tick until its state is (with leave set,
+ *     until it is no longer) state. Returns 1 once it is, 0 if pid is
+ *     gone or TIMEOUT seconds pass first.
+ */
+static int untilstate(pid_t pid, char state, int leave,
+		      const struct timespec *tick)
+{
+    double deadline = now() + TIMEOUT;
+    char st;
+
+    while ((st = procstate(pid)) != 0 && now() < deadline) {
+	if ((st == state) != leave)
+	    return 1;
+	nanosleep(tick, NULL);
+    }
+    return 0;
+}
+
+/* fgrate - Time n foreground jobs run one after another */
+static void fgrate(int n)
+{
+    char *cmds, *p;
+    double start, t;
+    int i;
+
+    if ((cmds = malloc(n * 16 + 64)) == NULL)
+	unix_error("malloc error");
+    for (i = 0, p = cmds; i < n; i++)
+	p += sprintf(p, "/bin/true\n");
+    sprintf(p, "/bin/echo jobbench-fg\n");
+    start = now();
+    t = send(cmds, "jobbench-fg", NULL);
+    csv("fg_spawn_rate", n, 1, n / (t - start), "jobs/s");
+    free(cmds);
+}
+
+/*
+ * bgrate - Time n background jobs that each live BGSLEEP seconds,
+ *     then wait for all of them to be gone
+ */
+static void bgrate(int n)
+{
+    char *cmds, *p;
+    double start, t;
+    int i;
+
+    if ((cmds = malloc(n * 32 + 64)) == NULL)
+	unix_error("malloc error");
+    for (i = 0, p = cmds; i < n; i++)
+	p += sprintf(p, "/bin/sleep " BGSLEEP " &\n");
+    sprintf(p, "/bin/echo jobbench-bg\n");
+    start = now();
+    t = send(cmds, "jobbench-bg", NULL);
+    csv("bg_spawn_rate", n, 1, n / (t - start), "jobs/s");
+    free(cmds);
+
+    sleep(atoi(BGSLEEP) + 1);
+    send("/bin/echo jobbench-reaped\n", "jobbench-reaped", NULL);
+}
+
+/*
+ * failed - Report a jobcontrol trial that failed, then kill its job
+ *     and wait for the shell to be back at its prompt
+ */
+static void failed(pid_t pid, int trial, const char *why)
+{
+    fprintf(stderr, "jobbench: trial %d: job (%d) %s\n", trial, (int) pid,
+	    procstate(pid) ? why : "is gone");
+    printf("%s,fg_resume_latency,1,%d,,failed\n", shellname, trial);
+    fflush(stdout);
+    kill(pid, SIGKILL);
+    send("/bin/echo jobbench-failed\n", "jobbench-failed", NULL);
+}
+
+/*
+ * jobcontrol - Stop a foreground job with SIGTSTP and bring it back
+ *     with fg, timing both, then kill it with SIGINT. A job that dies
+ *     or never stops or resumes fails the trial, which is reported
+ *     with no value and left behind with SIGKILL.
+ */
+static void jobcontrol(int trial)
+{
+    char line[MAXLINE];
+    struct timespec settle = { 0, 50000000 };
+    struct timespec tick = { 0, 100000 };    /* resume latency resolution */
+    double start, t;
+    int jid;
+    pid_t pid;
+
+    send("./myspin 100 &\n", "./myspin 100", line);
+    if (sscanf(line, "[%d] (%d)", &jid, &pid) != 2)
+	app_error("jobbench: cannot parse job line");
+    snprintf(line, sizeof(line), "fg %%%d\n", jid);
+    writeall(line);
+    nanosleep(&settle, NULL);    /* let the shell get into waitfg */
+
+    start = now();
+    kill(shell, SIGTSTP);
+    t = send("", "stopped by signal", NULL);
+    csv("tstp_latency", 1, trial, t - start, "s");
+
+    if (!untilstate(pid, 'T', 0, &settle)) {
+	failed(pid, trial, "never stopped");
+	return;
+    }
+    start = now();
+    writeall(line);
+    if (!untilstate(pid, 'T', 1, &tick)) {
+	failed(pid, trial, "never resumed");
+	return;
+    }
+    csv("fg_resume_latency", 1, trial, now() - start, "s");
+
+    nanosleep(&settle, NULL);
+    kill(shell, SIGINT);
+    send("", "terminated by signal", NULL);
+}
+
+int main(int argc, char **argv)
+{
+    int c, i, fgjobs = 500, trials = 20, in[2], outp[2];
+    char *bgjobs = "10,100,1000", *p;
+
+    while ((c = getopt(argc, argv, "+f:b:t:")) != EOF) {
+	switch (c) {
+	case 'f':
+	    fgjobs = atoi(optarg);
+	    break;
+	case 'b':
+	    bgjobs = optarg;
+	    break;
+	case 't':
+	    trials = atoi(optarg);
+	    break;
+	default:
+	    optind = argc;
+	}
+    }
+    if (optind >= argc || fgjobs < 1 || trials < 1) {
+	fprintf(stderr, "Usage: %s [-f <fgjobs>] [-b <bgjobs,...>] "
+		"[-t <trials>] <shell> [args...]\n", argv[0]);
+	exit(1);
+    }
+    for (i = optind; i < argc; i++)
+	snprintf(shellname + strlen(shellname), sizeof(shellname)
+		 - strlen(shellname), "%s%s", i > optind ? " " : "", argv[i]);
+
+    if (pipe(in) < 0 || pipe(outp) < 0)
+	unix_error("pipe error");
+    signal(SIGPIPE, SIG_IGN);
+    if ((shell = fork()) < 0)
+	unix_error("fork error");
+    if (shell == 0) {
+	dup2(in[0], STDIN_FILENO);
+	dup2(outp[1], STDOUT_FILENO);
+	close(in[0]);
+	close(in[1]);
+	close(outp[0]);
+	close(outp[1]);
+	signal(SIGPIPE, SIG_DFL);
+	execv(argv[optind], &argv[optind]);
+	unix_error("execv error");
+    }
+    close(in[0]);
+    close(outp[1]);
+    tosh = in[1];
+    fromsh = outp[0];
+
+    printf("shell,metric,param,trial,value,unit\n");
+    fgrate(fgjobs);
+    for (p = bgjobs; *p; p += *p == ',') {
+	if ((c = strtol(p, &p, 10)) > 0)
+	    bgrate(c);
+	if (*p != ',' && *p != '\0')
+	    break;
+    }
+    for (i = 1; i <= trials; i++)
+	jobcontrol(i);
+
+    close(tosh);
+    waitpid(shell, NULL, 0);
+    exit(0);
+}
@@ -1,160 +1,673 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 #include "jobs.h"
 
 extern int verbose;
-static int nextjid = 1;            /* next job ID to allocate */
 
 
 /***********************************************
  * Helper routines that manipulate the job list
  **********************************************/
 
+/* pidhash - Return the first PID hash entry to probe for pid */
+static int pidhash(struct joblist_t *jobs, pid_t pid)
+{
+    unsigned int h = (unsigned int) pid;
+
+    return (int) ((h ^ (h >> 16)) & jobs->pidmask);
+}
+
+/* pidfind - Return the PID hash entry holding pid, -1 if none */
+static int pidfind(struct joblist_t *jobs, pid_t pid)
+{
+    int i, slot;
+
+    for (i = pidhash(jobs, pid);
+	 (slot = jobs->pidmap[i].slot) != PIDMAP_EMPTY;
+	 i = (i + 1) & jobs->pidmask)
+	if (slot >= 0 && jobs->pidmap[i].pid == pid)
+	    return i;
+    return -1;
+}
+
+/* pidinsert - Enter pid, a member of the job in slot, into the PID hash */
+static void pidinsert(struct joblist_t *jobs, pid_t pid, int slot)
+{
+    int i;
+
+    i = pidhash(jobs, pid);
+    while (jobs->pidmap[i].slot >= 0)
+	i = (i + 1) & jobs->pidmask;
+    if (jobs->pidmap[i].slot == PIDMAP_EMPTY)
+	jobs->pidused++;
+    jobs->pidlive++;
+    jobs->pidmap[i].pid = pid;
+    jobs->pidmap[i].slot = slot;
+}
+
+/* pidrehash - Rebuild the PID hash with nbuckets entries */
+static int pidrehash(struct joblist_t *jobs, int nbuckets)
+{
+    struct pident_t *old = jobs->pidmap;
+    int i, oldn = old ? jobs->pidmask + 1 : 0;
+
+    if ((jobs->pidmap = malloc(nbuckets * sizeof(struct pident_t))) == NULL) {
+	jobs->pidmap = old;
+	return -1;
+    }
+    for (i = 0; i < nbuckets; i++)
+	jobs->pidmap[i].slot = PIDMAP_EMPTY;
+    jobs->pidmask = nbuckets - 1;
+    jobs->pidused = 0;
+    jobs->pidlive = 0;
+    for (i = 0; i < oldn; i++)
+	if (old[i].slot >= 0)
+	    pidinsert(jobs, old[i].pid, old[i].slot);
+    free(old);
+    return 0;
+}
+
+/* dropentry - Delete PID hash entry i */
+static void dropentry(struct joblist_t *jobs, int i)
+{
+    jobs->pidmap[i].slot = PIDMAP_DELETED;
+    jobs->pidlive--;
+}
+
+/* pidbuckets - PID hash size that holds npids PIDs at most half full */
+static int pidbuckets(int npids)
+{
+    int nbuckets = INITJOBS * 2;
+
+    while (npids * 2 > nbuckets)
+	nbuckets *= 2;
+    return nbuckets;
+}
+
+/*
+ * pidroom - Make sure the PID hash can take n more entries on top of
+ *     those set aside for queued jobs
+ */
+static int pidroom(struct joblist_t *jobs, int n)
+{
+    n += jobs->pidresv;
+    if ((jobs->pidused + n) * 4 <= (jobs->pidmask + 1) * 3)
+	return 0;
+    return pidrehash(jobs, pidbuckets(jobs->pidlive + n));
+}
+
+/* recsize - Arena bytes taken by a command line record of len chars */
+static int recsize(int len)
+{
+    int align = sizeof(struct cmdrec_t);
+
+    return (sizeof(struct cmdrec_t) + len + 1 + align - 1) & ~(align - 1);
+}
+
+/* compacttext - Slide live command line records down over dead ones */
+static void compacttext(struct joblist_t *jobs)
+{
+    int off, size, slot, to = 0;
+    struct cmdrec_t *rec;
+
+    for (off = 0; off < jobs->textused; off += size) {
+	rec = (struct cmdrec_t *) (jobs->text + off);
+	size = recsize(rec->len);
+	if ((slot = rec->slot) < 0)
+	    continue;
+	if (to != off)
+	    memmove(jobs->text + to, rec, size);
+	jobs->jobs[slot].cmdoff = to;
+	to += size;
+    }
+    jobs->textused = to;
+    jobs->textdead = 0;
+}
+
+/* reservetext - Make room for size more bytes in the text arena */
+static int reservetext(struct joblist_t *jobs, int size)
+{
+    char *text;
+    int newsize;
+
+    if (jobs->textused + size <= jobs->textsize)
+	return 0;
+
+    /* Reclaim deleted records first; only grow if that is not enough */
+    if (jobs->textdead > 0) {
+	compacttext(jobs);
+	if (jobs->textused + size <= jobs->textsize)
+	    return 0;
+    }
+    newsize = jobs->textsize * 2;
+    while (jobs->textused + size > newsize)
+	newsize *= 2;
+    if ((text = realloc(jobs->text, newsize)) == NULL)
+	return -1;
+    jobs->text = text;
+    jobs->textsize = newsize;
+    return 0;
+}
+
+/* growslots - Double the number of job slots */
+static int growslots(struct joblist_t *jobs)
+{
+    struct job_t *slots;
+    struct usage_t *usage;
+    int i, size = jobs->size * 2;
+
+    if ((usage = realloc(jobs->usage, size * sizeof(struct usage_t))) == NULL)
+	return -1;
+    jobs->usage = usage;
+    if ((slots = realloc(jobs->jobs, size * sizeof(struct job_t))) == NULL)
+	return -1;
+    for (i = jobs->size; i < size; i++)
+	clearjob(&slots[i]);
+    jobs->jobs = slots;
+    jobs->size = size;
+    return 0;
+}
+
+/* tvadd - Add timeval b to a */
+static void tvadd(struct timeval *a, const struct timeval *b)
+{
+    a->tv_sec += b->tv_sec;
+    a->tv_usec += b->tv_usec;
+    if (a->tv_usec >= 1000000) {
+	a->tv_sec++;
+	a->tv_usec -= 1000000;
+    }
+}
+
+/*
+ * procusage - Add what process pid has used so far, as /proc shows it,
+ *     to u. The process must still be a live member of process group
+ *     pgid, so a reaped PID that was handed to someone else is never
+ *     counted.
+ */
+static void procusage(pid_t pid, pid_t pgid, struct usage_t *u)
+{
+    char path[64], buf[1024], *p, state;
+    unsigned long minflt, majflt, utime, stime;
+    long hwm, tck = sysconf(_SC_CLK_TCK);
+    struct timeval tv;
+    FILE *fp;
+    size_t n;
+    int pgrp;
+
+    snprintf(path, sizeof(path), "/proc/%d/stat", (int) pid);
+    if ((fp = fopen(path, "r")) == NULL)
+	return;
+    n = fread(buf, 1, sizeof(buf) - 1, fp);
+    fclose(fp);
+    buf[n] = '\0';
+
+    /* The command name may hold anything, so parse after its last ')' */
+    if ((p = strrchr(buf, ')')) == NULL
+	|| sscanf(p + 1, " %c %*d %d %*d %*d %*d %*u %lu %*u %lu %*u %lu %lu",
+		  &state, &pgrp, &minflt, &majflt, &utime, &stime) != 6
+	|| state == 'Z' || pgrp != pgid)
+	return;
+    u->minflt += minflt;
+    u->majflt += majflt;
+    tv.tv_sec = utime / tck;
+    tv.tv_usec = utime % tck * 1000000 / tck;
+    tvadd(&u->utime, &tv);
+    tv.tv_sec = stime / tck;
+    tv.tv_usec = stime % tck * 1000000 / tck;
+    tvadd(&u->stime, &tv);
+
+    snprintf(path, sizeof(path), "/proc/%d/status", (int) pid);
+    if ((fp = fopen(path, "r")) == NULL)
+	return;
+    while (fgets(buf, sizeof(buf), fp) != NULL)
+	if (sscanf(buf, "VmHWM: %ld", &hwm) == 1 && hwm > u->maxrss)
+	    u->maxrss = hwm;
+    fclose(fp);
+}
+
+/* growjidmap - Make room in the JID map for job ID jid */
+static int growjidmap(struct joblist_t *jobs, int jid)
+{
+    int i, *map, size = jobs->jidsize * 2;
+
+    if (size <= jid)
+	size = jid + 1;
+    if (size > MAXJID + 1)
+	size = MAXJID + 1;
+    if ((map = realloc(jobs->jidmap, size * sizeof(int))) == NULL)
+	return -1;
+    for (i = jobs->jidsize; i < size; i++)
+	map[i] = -1;
+    jobs->jidmap = map;
+    jobs->jidsize = size;
+    return 0;
+}
+
 /* clearjob - Clear the entries in a job struct */
 void clearjob(struct job_t *job) {
     job->pid = 0;
     job->jid = 0;
     job->state = UNDEF;
-    job->cmdline[0] = '\0';
+    job->cmdoff = -1;
+    job->nprocs = 0;
+    job->lastpid = 0;
+    job->status = 0;
+    job->hastmodes = 0;
 }
 
 /* initjobs - Initialize the job list */
-void initjobs(struct job_t *jobs) {
+void initjobs(struct joblist_t *jobs) {
     int i;
 
-    for (i = 0; i < MAXJOBS; i++)
-	clearjob(&jobs[i]);
+    jobs->size = INITJOBS;
+    jobs->jidsize = INITJOBS + 1;
+    jobs->jobs = malloc(jobs->size * sizeof(struct job_t));
+    jobs->jidmap = malloc(jobs->jidsize * sizeof(int));
+    jobs->pidmap = NULL;
+    jobs->textsize = INITJOBS * 64;
+    jobs->text = malloc(jobs->textsize);
+    jobs->usage = malloc(jobs->size * sizeof(struct usage_t));
+    if (jobs->jobs == NULL || jobs->jidmap == NULL || jobs->text == NULL
+	|| jobs->usage == NULL)
+	unix_error("initjobs error");
+
+    for (i = 0; i < jobs->size; i++)
+	clearjob(&jobs->jobs[i]);
+    for (i = 0; i < jobs->jidsize; i++)
+	jobs->jidmap[i] = -1;
+    if (pidrehash(jobs, pidbuckets(0)) < 0)
+	unix_error("initjobs error");
+    jobs->count = 0;
+    jobs->firstfree = 0;
+    jobs->fg = -1;
+    jobs->nbg = 0;
+    jobs->pidresv = 0;
+    jobs->maxjid = 0;
+    jobs->nextjid = 1;
+    jobs->textused = 0;
+    jobs->textdead = 0;
 }
 
 /* maxjid - Returns largest allocated job ID */
-int maxjid(struct job_t *jobs) 
+int maxjid(struct joblist_t *jobs)
 {
-    int i, max=0;
+    return jobs->maxjid;
+}
 
-    for (i = 0; i < MAXJOBS; i++)
-	if (jobs[i].jid > max)
-	    max = jobs[i].jid;
-    return max;
+/*
+ * newjob - Give a job in the given state a slot, a JID and a copy of
+ *     cmdline, with room on the PID hash for npids more entries.
+ *     Returns the slot, or -1 (after reporting it) if there is none.
+ */
+static int newjob(struct joblist_t *jobs, int state, char *cmdline,
+		  int npids)
+{
+    int i, jid, len;
+    struct job_t *job;
+    struct cmdrec_t *rec;
+
+    if (jobs->count >= MAXJID) {
+	printf("Tried to create too many jobs\n");
+	return -1;
+    }
+
+    /* Job IDs wrap after MAXJID, so skip any that are still taken */
+    jid = jobs->nextjid;
+    while (jid < jobs->jidsize && jobs->jidmap[jid] >= 0)
+	jid = jid % MAXJID + 1;
+
+    len = strlen(cmdline);
+
+    /* Make room before touching anything, so a failure leaves the
+     * table as it was */
+    if ((jobs->count == jobs->size && growslots(jobs) < 0)
+	|| pidroom(jobs, npids) < 0
+	|| (jid >= jobs->jidsize && growjidmap(jobs, jid) < 0)
+	|| reservetext(jobs, recsize(len)) < 0) {
+	printf("addjob: out of memory\n");
+	return -1;
+    }
+
+    for (i = jobs->firstfree; jobs->jobs[i].state != UNDEF; i++)
+	;
+    jobs->firstfree = i + 1;
+    jobs->count++;
+
+    job = &jobs->jobs[i];
+    job->jid = jid;
+    job->state = state;
+    job->cmdoff = jobs->textused;
+    rec = (struct cmdrec_t *) (jobs->text + job->cmdoff);
+    rec->len = len;
+    rec->slot = i;
+    memcpy(rec + 1, cmdline, len + 1);
+    jobs->textused += recsize(len);
+    memset(&jobs->usage[i], 0, sizeof(struct usage_t));
+    clock_gettime(CLOCK_MONOTONIC, &jobs->usage[i].start);
+    jobs->jidmap[jid] = i;
+    if (jid > jobs->maxjid)
+	jobs->maxjid = jid;
+    jobs->nextjid = jid % MAXJID + 1;
+    return i;
 }
 
 /* addjob - Add a job to the job list */
-int addjob(struct job_t *jobs, pid_t pid, int state, char *cmdline) 
+int addjob(struct joblist_t *jobs, pid_t pid, int state, char *cmdline)
 {
     int i;
-    
+    struct job_t *job;
+
     if (pid < 1)
 	return 0;
+    if ((i = newjob(jobs, state, cmdline, 1)) < 0)
+	return 0;
 
-    for (i = 0; i < MAXJOBS; i++) {
-	if (jobs[i].pid == 0) {
-	    jobs[i].pid = pid;
-	    jobs[i].state = state;
-	    jobs[i].jid = nextjid++;
-	    if (nextjid > MAXJOBS)
-		nextjid = 1;
-	    strcpy(jobs[i].cmdline, cmdline);
-  	    if(verbose){
-	        printf("Added job [%d] %d %s\n", jobs[i].jid, jobs[i].pid, 
-                                                 jobs[i].cmdline);
-            }
-            return 1;
-	}
+    job = &jobs->jobs[i];
+    job->pid = pid;
+    job->nprocs = 1;
+    job->lastpid = pid;
+    pidinsert(jobs, pid, i);
+    if (state == FG)
+	jobs->fg = i;
+    if (state == BG)
+	jobs->nbg++;
+
+    if(verbose){
+	printf("Added job [%d] %d %s\n", job->jid, job->pid, cmdline);
     }
-    printf("Tried to create too many jobs\n");
-    return 0;
+    return 1;
 }
 
-/* deletejob - Delete a job whose PID=pid from the job list */
-int deletejob(struct job_t *jobs, pid_t pid) 
+/*
+ * queuejob - Add a job of nprocs processes that is not started yet.
+ *     Returns its JID, or 0 if it could not be added.
+ */
+int queuejob(struct joblist_t *jobs, int nprocs, char *cmdline)
 {
     int i;
 
+    if ((i = newjob(jobs, QU, cmdline, nprocs)) < 0)
+	return 0;
+    jobs->jobs[i].nprocs = nprocs;
+    jobs->pidresv += nprocs;
+    return jobs->jobs[i].jid;
+}
+
+/*
+ * runjob - Start queued job in the given state, now that its first
+ *     process pid is running. The rest are added with addproc.
+ */
+int runjob(struct joblist_t *jobs, struct job_t *job, pid_t pid, int state)
+{
+    int slot = job - jobs->jobs;
+
+    if (pid < 1 || job->state != QU)
+	return 0;
+
+    jobs->pidresv -= job->nprocs;
+    clock_gettime(CLOCK_MONOTONIC, &jobs->usage[slot].start);
+    job->pid = pid;
+    job->nprocs = 1;
+    job->lastpid = pid;
+    pidinsert(jobs, pid, slot);
+    job->state = UNDEF;
+    setjobstate(jobs, job, state);
+    return 1;
+}
+
+/* addproc - Add process pid to the job led by jobpid, as its last command */
+int addproc(struct joblist_t *jobs, pid_t jobpid, pid_t pid)
+{
+    int i, slot;
+
+    if (pid < 1 || (i = pidfind(jobs, jobpid)) < 0)
+	return 0;
+
+    slot = jobs->pidmap[i].slot;
+    if (pidroom(jobs, 1) < 0) {
+	printf("addproc: out of memory\n");
+	return 0;
+    }
+    pidinsert(jobs, pid, slot);
+    jobs->jobs[slot].nprocs++;
+    jobs->jobs[slot].lastpid = pid;
+    return 1;
+}
+
+/* freeslot - Release the slot, JID and command line of a job */
+static void freeslot(struct joblist_t *jobs, int slot)
+{
+    struct job_t *job = &jobs->jobs[slot];
+    struct cmdrec_t *rec;
+
+    rec = (struct cmdrec_t *) (jobs->text + job->cmdoff);
+    rec->slot = -1;
+    jobs->textdead += recsize(rec->len);
+    jobs->jidmap[job->jid] = -1;
+    if (jobs->fg == slot)
+	jobs->fg = -1;
+    if (job->state == BG)
+	jobs->nbg--;
+    clearjob(job);
+    if (--jobs->count == 0)
+	jobs->textused = jobs->textdead = 0;
+    if (slot < jobs->firstfree)
+	jobs->firstfree = slot;
+
+    while (jobs->maxjid > 0 && jobs->jidmap[jobs->maxjid] < 0)
+	jobs->maxjid--;
+    jobs->nextjid = jobs->maxjid + 1;
+}
+
+/*
+ * deletejob - Delete the job that process pid belongs to from the job
+ *     list. Any other processes in the job must already be reaped.
+ */
+int deletejob(struct joblist_t *jobs, pid_t pid)
+{
+    int i, slot;
+    struct job_t *job;
+
     if (pid < 1)
 	return 0;
 
-    for (i = 0; i < MAXJOBS; i++) {
-	if (jobs[i].pid == pid) {
-	    clearjob(&jobs[i]);
-	    nextjid = maxjid(jobs)+1;
-	    return 1;
-	}
+    if ((i = pidfind(jobs, pid)) < 0)
+	return 0;
+
+    slot = jobs->pidmap[i].slot;
+    job = &jobs->jobs[slot];
+    dropentry(jobs, i);
+    if (job->pid != pid && (i = pidfind(jobs, job->pid)) >= 0)
+	dropentry(jobs, i);
+    freeslot(jobs, slot);
+    return 1;
+}
+
+/*
+ * unqueuejob - Delete a queued job that will not be started after
+ *     all, giving back the PID hash room it had set aside
+ */
+int unqueuejob(struct joblist_t *jobs, struct job_t *job)
+{
+    if (job->state != QU)
+	return 0;
+    jobs->pidresv -= job->nprocs;
+    freeslot(jobs, job - jobs->jobs);
+    return 1;
+}
+
+
+/*
+ * reapproc - Note that process pid has exited, having used the
+ *     resources in ru (if not NULL), which are added to its job's.
+ *     Once every process in the job is gone the job is deleted and 1
+ *     is returned; if it was the FG job its usage is kept in lastfg.
+ *     The group leader stays on the PID hash until then, so the job
+ *     can still be found by its own pid.
+ */
+int reapproc(struct joblist_t *jobs, pid_t pid, const struct rusage *ru)
+{
+    int i;
+    struct job_t *job;
+    struct usage_t *u;
+
+    if (pid < 1 || (i = pidfind(jobs, pid)) < 0)
+	return 0;
+
+    job = &jobs->jobs[jobs->pidmap[i].slot];
+    u = &jobs->usage[jobs->pidmap[i].slot];
+    if (ru != NULL) {
+	tvadd(&u->utime, &ru->ru_utime);
+	tvadd(&u->stime, &ru->ru_stime);
+	if (ru->ru_maxrss > u->maxrss)
+	    u->maxrss = ru->ru_maxrss;
+	u->minflt += ru->ru_minflt;
+	u->majflt += ru->ru_majflt;
     }
-    return 0;
+    if (--job->nprocs > 0) {
+	if (pid != job->pid)
+	    dropentry(jobs, i);
+	return 0;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &u->end);
+    if (job->state == FG) {
+	jobs->lastfg = *u;
+	jobs->lastfgpid = job->pid;
+	jobs->lastfgstatus = job->status;
+    }
+    return deletejob(jobs, pid);
+}
+
+/* setjobstate - Change the state of a job, tracking the FG job */
+void setjobstate(struct joblist_t *jobs, struct job_t *job, int state)
+{
+    int slot = job - jobs->jobs;
+
+    if (state == FG)
+	jobs->fg = slot;
+    else if (jobs->fg == slot)
+	jobs->fg = -1;
+    jobs->nbg += (state == BG) - (job->state == BG);
+    job->state = state;
 }
 
 /* fgpid - Return PID of current foreground job, 0 if no such job */
-pid_t fgpid(struct job_t *jobs) {
-    int i;
+pid_t fgpid(struct joblist_t *jobs) {
+    return jobs->fg < 0 ? 0 : jobs->jobs[jobs->fg].pid;
+}
 
-    for (i = 0; i < MAXJOBS; i++)
-	if (jobs[i].state == FG)
-	    return jobs[i].pid;
-    return 0;
+/* jobcmdline - Return the command line of a job */
+const char *jobcmdline(struct joblist_t *jobs, struct job_t *job)
+{
+    return (const char *) ((struct cmdrec_t *) (jobs->text + job->cmdoff) + 1);
 }
 
 /* getjobpid  - Find a job (by PID) on the job list */
-struct job_t *getjobpid(struct job_t *jobs, pid_t pid) {
+struct job_t *getjobpid(struct joblist_t *jobs, pid_t pid) {
     int i;
 
     if (pid < 1)
 	return NULL;
-    for (i = 0; i < MAXJOBS; i++)
-	if (jobs[i].pid == pid)
-	    return &jobs[i];
-    return NULL;
+    if ((i = pidfind(jobs, pid)) < 0)
+	return NULL;
+    return &jobs->jobs[jobs->pidmap[i].slot];
 }
 
 /* getjobjid  - Find a job (by JID) on the job list */
-struct job_t *getjobjid(struct job_t *jobs, int jid) 
+struct job_t *getjobjid(struct joblist_t *jobs, int jid)
 {
-    int i;
-
-    if (jid < 1)
+    if (jid < 1 || jid >= jobs->jidsize || jobs->jidmap[jid] < 0)
 	return NULL;
-    for (i = 0; i < MAXJOBS; i++)
-	if (jobs[i].jid == jid)
-	    return &jobs[i];
-    return NULL;
+    return &jobs->jobs[jobs->jidmap[jid]];
 }
 
 /* pid2jid - Map process ID to job ID */
-int pid2jid(struct job_t *jobs, pid_t pid) 
+int pid2jid(struct joblist_t *jobs, pid_t pid)
+{
+    struct job_t *job = getjobpid(jobs, pid);
+
+    return job ? job->jid : 0;
+}
+
+/*
+ * jobusage - Store in u what job has used so far: the totals of its
+ *     reaped processes plus the live figures of the rest
+ */
+void jobusage(struct joblist_t *jobs, struct job_t *job, struct usage_t *u)
 {
+    int i, slot = job - jobs->jobs;
+
+    *u = jobs->usage[slot];
+    for (i = 0; i <= jobs->pidmask; i++)
+	if (jobs->pidmap[i].slot == slot)
+	    procusage(jobs->pidmap[i].pid, job->pid, u);
+    if (u->end.tv_sec == 0 && u->end.tv_nsec == 0)
+	clock_gettime(CLOCK_MONOTONIC, &u->end);
+}
+
+/*
+ * printusage - Print the real, user and sys time and peak RSS in u,
+ *     on one line or on one line each the way time(1) does
+ */
+void printusage(const struct usage_t *u, int oneline)
+{
+    double t[3];
+    const char *name[3] = { "real", "user", "sys" };
     int i;
 
-    if (pid < 1)
-	return 0;
-    for (i = 0; i < MAXJOBS; i++)
-	if (jobs[i].pid == pid) {
-            return jobs[i].jid;
-        }
-    return 0;
+    t[0] = (u->end.tv_sec - u->start.tv_sec)
+	+ (u->end.tv_nsec - u->start.tv_nsec) / 1e9;
+    t[1] = u->utime.tv_sec + u->utime.tv_usec / 1e6;
+    t[2] = u->stime.tv_sec + u->stime.tv_usec / 1e6;
+    for (i = 0; i < 3; i++)
+	printf(oneline ? "%s %dm%.3fs  " : "%s\t%dm%.3fs\n", name[i],
+	       (int) (t[i] / 60), t[i] - 60 * (int) (t[i] / 60));
+    if (oneline)
+	printf("maxrss %ldK  faults %ld/%ld\n", u->maxrss, u->minflt,
+	       u->majflt);
+    else
+	printf("maxrss\t%ldK\n", u->maxrss);
 }
 
-/* listjobs - Print the job list */
-void listjobs(struct job_t *jobs) 
+/*
+ * listjobs - Print the job list. With usage, each job is followed by
+ *     an indented line of what it has used so far.
+ */
+void listjobs(struct joblist_t *jobs, int usage)
 {
     int i;
-    
-    for (i = 0; i < MAXJOBS; i++) {
-	if (jobs[i].pid != 0) {
-	    printf("[%d] (%d) ", jobs[i].jid, jobs[i].pid);
-	    switch (jobs[i].state) {
-		case BG: 
+    struct job_t *job;
+    struct usage_t u;
+
+    for (i = 0; i < jobs->size; i++) {
+	job = &jobs->jobs[i];
+	if (job->state == QU) {
+	    printf("[%d] (-) Queued %s", job->jid, jobcmdline(jobs, job));
+	} else if (job->state != UNDEF) {
+	    printf("[%d] (%d) ", job->jid, job->pid);
+	    switch (job->state) {
+		case BG:
 		    printf("Running ");
 		    break;
-		case FG: 
+		case FG:
 		    printf("Foreground ");
 		    break;
-		case ST: 
+		case ST:
 		    printf("Stopped ");
 		    break;
 	    default:
-		    printf("listjobs: Internal error: job[%d].state=%d ", 
-			   i, jobs[i].state);
+		    printf("listjobs: Internal error: job[%d].state=%d ",
+			   i, job->state);
+	    }
+	    printf("%s", jobcmdline(jobs, job));
+	    if (usage) {
+		jobusage(jobs, job, &u);
+		printf("    ");
+		printusage(&u, 1);
 	    }
-	    printf("%s", jobs[i].cmdline);
 	}
     }
 }
@@ -2,6 +2,10 @@
 #define _JOBS_H_
 
 #include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <termios.h>
 #include "util.h"
 
 /* Job states */
@@ -9,15 +13,20 @@
 #define FG 1    /* running in foreground */
 #define BG 2    /* running in background */
 #define ST 3    /* stopped */
+#define QU 4    /* queued, not started yet */
 
 /* 
- * Jobs states: FG (foreground), BG (background), ST (stopped)
+ * Jobs states: FG (foreground), BG (background), ST (stopped),
+ * QU (queued)
  * Job state transitions and enabling actions:
  *     FG -> ST  : ctrl-z
  *     ST -> FG  : fg command
  *     ST -> BG  : bg command
  *     BG -> FG  : fg command
- * At most 1 job can be in the FG state.
+ *     QU -> BG  : a running job finishes or stops
+ *     QU -> FG  : fg command
+ * At most 1 job can be in the FG state. A queued job has a JID and
+ * a command line but no processes, so its pid is 0.
  */
 
 
@@ -25,18 +34,114 @@ struct job_t {              /* The job struct */
     pid_t pid;              /* job PID */
     int jid;                /* job ID [1, 2, ...] */
     int state;              /* UNDEF, BG, FG, or ST */
-    char cmdline[MAXLINE];  /* command line */
+    int cmdoff;             /* command line record in the text arena */
+    int nprocs;             /* processes in the job not yet reaped,
+                               or to be started if it is queued */
+    pid_t lastpid;          /* PID of the last command in a pipeline */
+    int status;             /* its wait status, once it is reaped */
+    int hastmodes;          /* tmodes were saved when it last stopped */
+    struct termios tmodes;  /* its terminal modes, restored by fg */
+};
+
+/*
+ * Resources a job has used, summed over its processes as they are
+ * reaped with wait4. The times are CLOCK_MONOTONIC; end stays zero
+ * until the last process is gone.
+ */
+struct usage_t {
+    struct timespec start;  /* when the job was added */
+    struct timespec end;    /* when its last process was reaped */
+    struct timeval utime;   /* user CPU time */
+    struct timeval stime;   /* system CPU time */
+    long maxrss;            /* peak RSS of its largest process, in KiB */
+    long minflt;            /* page faults served without I/O */
+    long majflt;            /* page faults that needed I/O */
+};
+
+/*
+ * A job is a process group: one process, or every command of a
+ * pipeline. The job's pid is the group leader's and is what the
+ * job is listed and signalled by, but every member PID can be used
+ * to look the job up.
+ */
+#define PIDMAP_EMPTY   -1   /* PID hash entry that was never used */
+#define PIDMAP_DELETED -2   /* PID hash entry whose process is gone */
+
+struct pident_t {           /* A PID hash entry */
+    pid_t pid;              /* member PID */
+    int slot;               /* slot of its job, or PIDMAP_* */
+};
+
+/*
+ * Command lines live in a text arena owned by the job table, away
+ * from the job structs, so scanning jobs never drags the text into
+ * the cache. Each record is a struct cmdrec_t followed by the
+ * NUL-terminated text, padded to the header's alignment.
+ */
+struct cmdrec_t {
+    int len;                /* length of the text, excluding the NUL */
+    int slot;               /* owning job slot, -1 once deleted */
+};
+
+/*
+ * The job table. Slots are handed out lowest-free-first so listjobs
+ * prints jobs in the same order the old fixed array did. Two indexes
+ * give O(1) lookup: an open-addressed hash from PID to slot and a
+ * direct-mapped array from JID to slot. The slot of the FG job is
+ * cached so fgpid never scans.
+ *
+ * Only addjob, queuejob and addproc allocate or move memory, and they
+ * must be called with SIGCHLD blocked. deletejob, reapproc and
+ * setjobstate only touch memory that is already allocated, so
+ * sigchld_handler may call them. For the same reason a jobcmdline
+ * pointer is only good until the next addjob. queuejob sets aside the
+ * PID hash room a queued job will need, so runjob, and addproc for the
+ * rest of that job, never allocate.
+ */
+struct joblist_t {
+    struct job_t *jobs;     /* job slots */
+    int size;               /* number of allocated slots */
+    int count;              /* number of live jobs */
+    int firstfree;          /* no free slot below this index */
+    struct pident_t *pidmap; /* PID hash */
+    int pidmask;            /* PID hash size - 1 (size is a power of 2) */
+    int pidused;            /* live plus deleted PID hash entries */
+    int pidlive;            /* live PID hash entries */
+    int pidresv;            /* entries set aside for queued jobs */
+    int *jidmap;            /* JID -> slot index, -1 if unused */
+    int jidsize;            /* number of entries in jidmap */
+    int fg;                 /* slot of the FG job, -1 if none */
+    int nbg;                /* number of jobs in the BG state */
+    int maxjid;             /* largest allocated job ID */
+    int nextjid;            /* next job ID to allocate */
+    char *text;             /* command line arena */
+    int textsize;           /* bytes allocated for the arena */
+    int textused;           /* bytes handed out, live or dead */
+    int textdead;           /* bytes held by deleted jobs */
+    struct usage_t *usage;  /* resources of the job in each slot */
+    struct usage_t lastfg;  /* resources of the last FG job to finish */
+    pid_t lastfgpid;        /* and its pid, 0 if none yet */
+    int lastfgstatus;       /* and its wait status */
 };
 
 void clearjob(struct job_t *job);
-void initjobs(struct job_t *jobs);
-int maxjid(struct job_t *jobs); 
-int addjob(struct job_t *jobs, pid_t pid, int state, char *cmdline);
-int deletejob(struct job_t *jobs, pid_t pid); 
-pid_t fgpid(struct job_t *jobs);
-struct job_t *getjobpid(struct job_t *jobs, pid_t pid);
-struct job_t *getjobjid(struct job_t *jobs, int jid); 
-int pid2jid(struct job_t *jobs, pid_t pid); 
-void listjobs(struct job_t *jobs);
+void initjobs(struct joblist_t *jobs);
+int maxjid(struct joblist_t *jobs);
+int addjob(struct joblist_t *jobs, pid_t pid, int state, char *cmdline);
+int addproc(struct joblist_t *jobs, pid_t jobpid, pid_t pid);
+int queuejob(struct joblist_t *jobs, int nprocs, char *cmdline);
+int runjob(struct joblist_t *jobs, struct job_t *job, pid_t pid, int state);
+int unqueuejob(struct joblist_t *jobs, struct job_t *job);
+int deletejob(struct joblist_t *jobs, pid_t pid);
+int reapproc(struct joblist_t *jobs, pid_t pid, const struct rusage *ru);
+void setjobstate(struct joblist_t *jobs, struct job_t *job, int state);
+pid_t fgpid(struct joblist_t *jobs);
+const char *jobcmdline(struct joblist_t *jobs, struct job_t *job);
+struct job_t *getjobpid(struct joblist_t *jobs, pid_t pid);
+struct job_t *getjobjid(struct joblist_t *jobs, int jid);
+int pid2jid(struct joblist_t *jobs, pid_t pid);
+void listjobs(struct joblist_t *jobs, int usage);
+void jobusage(struct joblist_t *jobs, struct job_t *job, struct usage_t *u);
+void printusage(const struct usage_t *u, int oneline);
 
 #endif
@@ -0,0 +1,235 @@
+#define _GNU_SOURCE         /* for POSIX_SPAWN_TCSETPGROUP */
+#include <stdio.h>
+#include <stdio_ext.h>      /* for __fpurge */
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/types.h>
+#include "util.h"
+#include "launch.h"
+#include "spawnsrv.h"
+
+extern char **environ;      /* defined in libc */
+
+
+/*
+ * openredir - Open the file of redirection r, close-on-exec so that
+ *     only the copy dup'd onto r->fd survives into the program.
+ *     Reports the failure and returns -1 if it cannot be opened.
+ */
+int openredir(const struct redir_t *r)
+{
+    int fd;
+
+    if ((fd = open(r->path, r->flags | O_CLOEXEC, 0666)) < 0)
+	printf("%s: %s\n", r->path, strerror(errno));
+    return fd;
+}
+
+/*
+ * applyredirs - Apply the redirections of proc in order, in the child
+ *     after fork. Returns -1 if a file could not be opened.
+ */
+static int applyredirs(const struct proc_t *proc)
+{
+    const struct redir_t *r;
+    int fd;
+
+    for (r = proc->redirs; r < proc->redirs + proc->nredirs; r++) {
+	if (r->path == NULL) {
+	    dup2(r->dupfd, r->fd);
+	    continue;
+	}
+	if ((fd = openredir(r)) < 0)
+	    return -1;
+	if (fd != r->fd) {
+	    dup2(fd, r->fd);
+	    close(fd);
+	} else {
+	    fcntl(fd, F_SETFD, 0);  /* landed on r->fd itself; keep it */
+	}
+    }
+    return 0;
+}
+
+/*
+ * launch_fork - Start proc with a full fork. The child joins its
+ *     process group, takes the terminal if proc has one to give,
+ *     installs its stdin and stdout, applies its
+ *     redirections, restores mask and execs; if a redirection or the
+ *     exec fails the child reports it and exits, so the caller always
+ *     gets a pid.
+ */
+static pid_t launch_fork(struct proc_t *proc, const sigset_t *mask)
+{
+    pid_t pid;
+
+    if ((pid = fork()) != 0) {
+	/* Set the group from this side too, so later pipeline stages
+	 * can join it whichever process runs first */
+	if (pid > 0) {
+	    setpgid(pid, proc->pgid ? proc->pgid : pid);
+	    if (proc->ttyfd >= 0)
+		tcsetpgrp(proc->ttyfd, proc->pgid ? proc->pgid : pid);
+	}
+	return pid;
+    }
+
+    /* Change the process group of child as it will ensure only
+     * one process is in the foreground process group. Also
+     * restore the caller's signal mask, unblocking SIGCHLD.
+     */
+    setpgid(0, proc->pgid);
+    sigprocmask(SIG_SETMASK, mask, NULL);
+
+    /* Both sides hand over the terminal, so the program cannot read
+     * it before its group owns it. The shell ignores the terminal
+     * stop signals, and ignored signals survive exec. */
+    if (proc->ttyfd >= 0)
+	tcsetpgrp(proc->ttyfd, getpgrp());
+    Signal(SIGTTIN, SIG_DFL);
+    Signal(SIGTTOU, SIG_DFL);
+
+    /* A queued job may be started from the SIGCHLD handler while the
+     * shell still has output buffered; that copy is the shell's to
+     * write, not ours. */
+    __fpurge(stdout);
+
+    /* Pipe ends are close-on-exec, so only the copies dup'd onto
+     * stdin and stdout survive into the program */
+    if (proc->infd >= 0)
+	dup2(proc->infd, STDIN_FILENO);
+    if (proc->outfd >= 0)
+	dup2(proc->outfd, STDOUT_FILENO);
+
+    /* Redirections go on top of the pipe ends, left to right, so
+     * "> f 2>&1" sends both stdout and stderr to f */
+    if (applyredirs(proc) < 0) {
+	fflush(stdout);
+	_exit(1);
+    }
+
+    /* Cited from B&O pg. 791. _exit, since the shell's atexit
+     * handlers (stats, buffered notices) are not the child's to run. */
+    if (execve(proc->path, proc->argv,
+	       proc->envp ? proc->envp : environ) < 0) {
+	printf("%s: Command not found\n", proc->argv[0]);
+	fflush(stdout);
+	_exit(1);
+    }
+    return 0; /* not reached */
+}
+
+/*
+ * launch_spawn - Start proc with posix_spawn. glibc implements it
+ *     with clone(CLONE_VM | CLONE_VFORK), so no page tables are copied
+ *     no matter how large the shell's heap is. The process group,
+ *     signal mask and descriptors are set by the spawn attributes and
+ *     file actions before the exec, and exec failures come back to us
+ *     instead of dying in a child. Redirected files are opened here,
+ *     close-on-exec, so open errors are told apart from exec errors;
+ *     the file actions only dup them into place.
+ */
+static pid_t launch_spawn(struct proc_t *proc, const sigset_t *mask)
+{
+    posix_spawnattr_t attr;
+    posix_spawn_file_actions_t fa;
+    sigset_t dfl;
+    pid_t pid;
+    int i, err, nfds = 0, fds[MAXREDIRS];
+
+    for (i = 0; i < proc->nredirs; i++) {
+	if (proc->redirs[i].path == NULL)
+	    continue;
+	if ((fds[nfds] = openredir(&proc->redirs[i])) < 0) {
+	    while (nfds > 0)
+		close(fds[--nfds]);
+	    return 0;
+	}
+	nfds++;
+    }
+
+    sigemptyset(&dfl);
+    sigaddset(&dfl, SIGINT);
+    sigaddset(&dfl, SIGTSTP);
+    sigaddset(&dfl, SIGCHLD);
+    sigaddset(&dfl, SIGQUIT);
+    sigaddset(&dfl, SIGTTIN);
+    sigaddset(&dfl, SIGTTOU);
+
+    if ((err = posix_spawnattr_init(&attr)) != 0)
+	goto out;
+    if ((err = posix_spawn_file_actions_init(&fa)) != 0) {
+	posix_spawnattr_destroy(&attr);
+	goto out;
+    }
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP
+			     | POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+    posix_spawnattr_setpgroup(&attr, proc->pgid);
+    posix_spawnattr_setsigmask(&attr, mask);
+    posix_spawnattr_setsigdefault(&attr, &dfl);
+#ifdef POSIX_SPAWN_TCSETPGROUP
+    if (proc->ttyfd >= 0) {
+	posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP
+				 | POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF
+				 | POSIX_SPAWN_TCSETPGROUP);
+	posix_spawnattr_tcsetpgrp_np(&attr, proc->ttyfd);
+    }
+#endif
+    if (proc->infd >= 0)
+	posix_spawn_file_actions_adddup2(&fa, proc->infd, STDIN_FILENO);
+    if (proc->outfd >= 0)
+	posix_spawn_file_actions_adddup2(&fa, proc->outfd, STDOUT_FILENO);
+    for (i = 0, nfds = 0; i < proc->nredirs; i++) {
+	if (proc->redirs[i].path == NULL)
+	    posix_spawn_file_actions_adddup2(&fa, proc->redirs[i].dupfd,
+					     proc->redirs[i].fd);
+	else
+	    posix_spawn_file_actions_adddup2(&fa, fds[nfds++],
+					     proc->redirs[i].fd);
+    }
+
+    err = posix_spawn(&pid, proc->path, &fa, &attr, proc->argv,
+		      proc->envp ? proc->envp : environ);
+    posix_spawn_file_actions_destroy(&fa);
+    posix_spawnattr_destroy(&attr);
+    if (err == 0 && proc->ttyfd >= 0)
+	tcsetpgrp(proc->ttyfd, proc->pgid ? proc->pgid : pid);
+
+ out:
+    while (nfds > 0)
+	close(fds[--nfds]);
+    if (err == EAGAIN || err == ENOMEM) {
+	errno = err;
+	return -1;
+    }
+    if (err != 0) {
+	printf("%s: Command not found\n", proc->argv[0]);
+	return 0;
+    }
+    return pid;
+}
+
+/*
+ * launch - Start proc in its process group, with the signal mask set
+ *     to mask once it runs. The caller must have SIGCHLD blocked so
+ *     the process cannot be reaped before it is added to the job list.
+ *
+ * Returns the child's pid, 0 if the command could not be started
+ * (already reported), or -1 with errno set if no process was created.
+ */
+pid_t launch(struct proc_t *proc, int mode, const sigset_t *mask)
+{
+    pid_t pid;
+
+    if (mode == LAUNCH_SPAWN)
+	return launch_spawn(proc, mask);
+    if (mode == LAUNCH_SERVER
+	&& ((pid = srvlaunch(proc, mask)) >= 0 || errno != ENOTCONN))
+	return pid;
+    return launch_fork(proc, mask);
+}
@@ -0,0 +1,35 @@
+#ifndef _LAUNCH_H_
+#define _LAUNCH_H_
+
+#include <signal.h>
+#include <sys/types.h>
+
+/* Launch modes */
+#define LAUNCH_FORK  0   /* fork, then setpgid and execve in the child */
+#define LAUNCH_SPAWN 1   /* posix_spawn with the pgroup and mask set */
+#define LAUNCH_SERVER 2  /* ask the spawn server (spawnsrv.c) to fork */
+
+struct redir_t {            /* One redirection, applied in order */
+    int fd;                 /* descriptor being redirected */
+    const char *path;       /* file to open, or NULL to copy dupfd */
+    int flags;              /* open flags for path */
+    int dupfd;              /* descriptor fd becomes a copy of */
+};
+
+struct proc_t {             /* One process to start */
+    const char *path;       /* program to run */
+    char **argv;            /* its arguments */
+    pid_t pgid;             /* process group to join, 0 to lead a new one */
+    int infd;               /* becomes stdin, -1 to inherit the shell's */
+    int outfd;              /* becomes stdout, -1 to inherit the shell's */
+    struct redir_t *redirs; /* redirections, applied after the pipe ends */
+    int nredirs;            /* number of redirections */
+    int ttyfd;              /* terminal to give the group, -1 for none */
+    char **envp;            /* its environment, NULL for environ */
+    unsigned long envgen;   /* changes whenever envp's contents do */
+};
+
+int openredir(const struct redir_t *r);
+pid_t launch(struct proc_t *proc, int mode, const sigset_t *mask);
+
+#endif
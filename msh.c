@@ -3,7 +3,9 @@
  * 
  * <Put your name and login ID here>
  */
+#define _GNU_SOURCE         /* for pipe2 and ppoll */
 #include <stdio.h>
+#include <stdio_ext.h>      /* for __fpending */
 #include <stdlib.h>
 #include <unistd.h>
 #include <string.h>
@@ -11,31 +13,133 @@
 #include <signal.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/resource.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
 #include "util.h"
 #include "jobs.h"
+#include "launch.h"
+#include "pathcache.h"
+#include "evloop.h"
+#include "input.h"
+#include "stats.h"
+#include "fastcmd.h"
+#include "spawnsrv.h"
+#include "vars.h"
+#include "ast.h"
 
 
 /* Global variables */
 int verbose = 0;            /* if true, print additional output */
+int launchmode = LAUNCH_FORK; /* how eval starts jobs */
+int eventmode = 0;          /* if true, handle signals in an event loop */
+int fastmode = 0;           /* if true, run echo, test etc. in the shell */
 
 extern char **environ;      /* defined in libc */
 static char prompt[] = "msh> ";    /* command line prompt (DO NOT CHANGE) */
-static struct job_t jobs[MAXJOBS]; /* The job list */
+static char prompt2[] = "> ";      /* prompt for the rest of a command */
+static struct joblist_t jobs;      /* The job list */
+static sigset_t childmask;         /* signal mask that jobs start with */
+static struct arena_t arena;       /* words of the line being run */
+static int maxbg = 0;              /* most BG jobs at once, 0 if no limit */
+static int jobsdone;               /* jobs sigchld_handler has seen finish */
+static struct sio_t notes;         /* job notices not yet written */
+static int ttyfd = -1;             /* the terminal jobs are handed, or -1 */
+static int cmdfd = -1;             /* where commands are read from, or -1 */
+static pid_t shellpgid;            /* the shell's own process group */
+static pid_t shellpid;             /* the shell itself, not a forked child */
+static struct termios shelltmodes; /* and its terminal modes */
+static int laststatus;             /* exit status of the last command, $? */
+static char **childenv;            /* environment jobs start with */
+static unsigned long childenvgen;  /* its generation, from varenv */
+
+/*
+ * A growing string, for building command lines
+ */
+struct strbuf_t {
+    char *s;
+    size_t len;
+    size_t size;
+};
+static struct strbuf_t script;     /* lines of an unfinished command */
+
+/*
+ * An item of the parallel builtin: one input line, run as one
+ * background job. sigchld_handler fills in status and done when the
+ * item's job finishes.
+ */
+struct paritem_t {
+    pid_t pid;              /* leader of the item's job, 0 if slot free */
+    long seq;               /* its line number in the input */
+    char *line;             /* the line, for the report */
+    int status;             /* wait status of its last command */
+    int done;               /* set once its job is gone or stopped */
+};
+static struct paritem_t *paritems; /* item slots of a running parallel */
+static int parn;                   /* how many */
+static struct paritem_t *parnext;  /* slot eval gives its next BG job */
+static volatile sig_atomic_t interrupted; /* ctrl-c with no FG job */
+
+/*
+ * A background job held back by the maxbg limit. Its words, pipeline
+ * and redirections are copied out of the arena into one block along
+ * with the resolved command paths, so it can be started later without
+ * tokenizing again. The shell starts it from its own flow, never from
+ * sigchld_handler (see startready), and frees the block once it has.
+ */
+struct qjob_t {
+    struct qjob_t *next;    /* next job in the queue */
+    int jid;                /* its JID on the job list */
+    int n;                  /* commands in its pipeline */
+    char ***stages;         /* argv of each command */
+    const char **paths;     /* program each command runs */
+    struct redir_t (*redirs)[MAXREDIRS]; /* redirections of each */
+    int *nredirs;           /* and how many */
+};
+static struct qjob_t *qhead, *qtail; /* queued jobs, oldest first */
 /* End global variables */
 
 
 /* Function prototypes */
 
 /* Here are the functions that you will implement */
-void eval(char *cmdline);
+void eval(char *cmdline, size_t len);
+static void runcmd(char **argv, int isBG, char *cmdline);
+static void runtree(struct node_t *n);
+static int fgstatus(pid_t pid);
 int builtin_cmd(char **argv);
 void do_bgfg(char **argv);
+void do_bglimit(char **argv);
+void do_wait(char **argv);
+void do_parallel(char **argv, struct redir_t *redirs, int nredirs);
+void do_hash(char **argv);
+void do_stats(char **argv);
+void do_export(char **argv);
+void do_unset(char **argv);
+void do_env(void);
+static void updateenv(void);
+static void writestats(void);
+static void runqueue(struct sio_t *out);
+static int nap(double secs);
+static int runfast(char **argv);
+static void sbput(struct strbuf_t *b, const char *s, size_t n);
+static void ttyinit(void);
+static void givetty(struct job_t *job);
+static void taketty(pid_t pid);
+static void flushout(void);
+static void exitflush(void);
+static int inwait(int wantinput);
+static void startnow(struct job_t *job, int state);
+static void startmore(void);
+static void startready(void);
 void waitfg(pid_t pid);
 
 void sigchld_handler(int sig);
 void sigtstp_handler(int sig);
+void sigalrm_handler(int sig);
 void sigint_handler(int sig);
+void evdispatch(int sig);
 
 /* Here are helper routines that we've provided for you */
 void usage(void);
@@ -49,15 +153,20 @@ void sigquit_handler(int sig);
 int main(int argc, char **argv) 
 {
     char c;
-    char cmdline[MAXLINE];
+    char *cmdline;
+    char *cmdstr = NULL; /* commands given with -c */
+    size_t len;
     int emit_prompt = 1; /* emit prompt (default) */
+    int fd;
+    sigset_t evsigs;
+    struct input_t input;
 
     /* Redirect stderr to stdout (so that driver will get all output
      * on the pipe connected to stdout) */
     dup2(1, 2);
 
     /* Parse the command line */
-    while ((c = getopt(argc, argv, "hvp")) != EOF) {
+    while ((c = getopt(argc, argv, "hvpsSebj:c:")) != EOF) {
         switch (c) {
         case 'h':             /* print help message */
             usage();
@@ -68,302 +177,1820 @@ int main(int argc, char **argv)
         case 'p':             /* don't print a prompt */
             emit_prompt = 0;  /* handy for automatic testing */
 	    break;
+        case 's':             /* start jobs with posix_spawn */
+            launchmode = LAUNCH_SPAWN;
+	    break;
+        case 'S':             /* start jobs through a spawn server */
+            launchmode = LAUNCH_SERVER;
+	    break;
+        case 'e':             /* run signal handlers from an event loop */
+            eventmode = 1;
+	    break;
+        case 'b':             /* run echo, test etc. without a process */
+            fastmode = 1;
+	    break;
+        case 'j':             /* run at most this many BG jobs at once */
+            maxbg = atoi(optarg);
+	    break;
+        case 'c':             /* run the given commands and exit */
+            cmdstr = optarg;
+	    break;
 	default:
             usage();
 	}
     }
 
+    /* The spawn server is a copy of the shell as it is now, small */
+    if (launchmode == LAUNCH_SERVER && srvstart() < 0) {
+        launchmode = LAUNCH_FORK;
+    }
+
+    /* Commands come from -c, from a script named after the options or
+     * from stdin. Scripts and -c run in batch mode, with no prompts.
+     */
+    if (cmdstr != NULL) {
+        inopenstr(&input, cmdstr);
+    } else if (optind < argc) {
+        if ((fd = open(argv[optind], O_RDONLY | O_CLOEXEC)) < 0) {
+            printf("%s: %s\n", argv[optind], strerror(errno));
+            exit(1);
+        }
+        inopenfd(&input, fd);
+    } else {
+        inopenfd(&input, STDIN_FILENO);
+    }
+    if (cmdstr != NULL || optind < argc) {
+        emit_prompt = 0;
+    }
+
+    /* stdout is line buffered on a terminal and fully buffered
+     * otherwise, as stdio sets it up; it is only flushed, with
+     * flushout, before the shell prompts, starts a job or blocks.
+     */
+    input.wait = inwait;
+    cmdfd = input.fd;
+    shellpid = getpid();
+    atexit(exitflush);
+
+    /* Jobs start with the mask we were started with, even though the
+     * event loop keeps signals blocked in the shell itself */
+    sigprocmask(SIG_BLOCK, NULL, &childmask);
+
     /* Install the signal handlers */
 
     /* These are the ones you will need to implement */
     Signal(SIGINT,  sigint_handler);   /* ctrl-c */
     Signal(SIGTSTP, sigtstp_handler);  /* ctrl-z */
     Signal(SIGCHLD, sigchld_handler);  /* Terminated or stopped child */
+    Signal(SIGALRM, sigalrm_handler);  /* sleep run by the shell is up */
+
+    /* In event mode the same handlers are called synchronously, from
+     * evwait, instead of interrupting the shell wherever it is */
+    if (eventmode) {
+        sigemptyset(&evsigs);
+        sigaddset(&evsigs, SIGINT);
+        sigaddset(&evsigs, SIGTSTP);
+        sigaddset(&evsigs, SIGCHLD);
+        sigaddset(&evsigs, SIGALRM);
+        evinit(&evsigs, evdispatch, input.fd);
+    }
 
     /* This one provides a clean way to kill the shell */
     Signal(SIGQUIT, sigquit_handler); 
 
+    /* Typed commands get job control through the terminal */
+    if (cmdstr == NULL && optind >= argc) {
+        ttyinit();
+    }
+
     /* Initialize the job list */
-    initjobs(jobs);
+    initjobs(&jobs);
+    fastinit(nap);
+
+    /* The environment becomes exported shell variables, and is what
+     * jobs get until one of them changes */
+    varinit(environ);
+    childenv = environ;
+
+    /* Leave the shell's counters behind in $MSHSTATS when it exits */
+    if (getenv("MSHSTATS") != NULL) {
+        atexit(writestats);
+    }
 
     /* Execute the shell's read/eval loop */
     while (1) {
 
 	/* Read command line */
 	if (emit_prompt) {
-	    printf("%s", prompt);
-	    fflush(stdout);
+	    printf("%s", script.len > 0 ? prompt2 : prompt);
+	    flushout();
 	}
-	if ((fgets(cmdline, MAXLINE, stdin) == NULL) && ferror(stdin))
-	    app_error("fgets error");
-	if (feof(stdin)) { /* End of file (ctrl-d) */
-	    fflush(stdout);
+	if ((cmdline = inreadline(&input, &len)) == NULL) { /* End of file */
+	    if (script.len > 0) {
+		printf("syntax error: unexpected end of file\n");
+		exit(2);
+	    }
 	    exit(0);
 	}
 
 	/* Evaluate the command line */
-	eval(cmdline);
-	fflush(stdout);
-	fflush(stdout);
+	eval(cmdline, len);
     } 
 
     exit(0); /* control never reaches here */
 }
   
-/* 
- * eval - Evaluate the command line that the user has just typed in
- * 
- * If the user has requested a built-in command (quit, jobs, bg or fg)
- * then execute it immediately. Otherwise, fork a child process and
- * run the job in the context of the child. If the job is running in
- * the foreground, wait for it to terminate and then return.  Note:
- * each child process must have a unique process group ID so that our
- * background children don't receive SIGINT (SIGTSTP) from the kernel
- * when we type ctrl-c (ctrl-z) at the keyboard.  
-*/
-void eval(char *cmdline) 
+/*
+ * flushout - Write out what the shell has printed, then the job
+ *    notices sigchld_handler held back so they would not overtake it
+ */
+static void flushout(void)
 {
-    /* Juan driving */
-    int isBG, isCommand;
-    char *argv[MAXARGS];
-    pid_t pid;
-    sigset_t mask;
+    sigset_t mask, prev;
 
-    /* Call parseline to change words of input into argv and save
-    * return value into isBG to know first word is a BG job. */
-    isBG = parseline(cmdline, argv);
+    fflush(stdout);
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &mask, &prev);
+    sio_flush(&notes);
+    sigprocmask(SIG_SETMASK, &prev, NULL);
+}
 
-    /* Return back to shell if no input was detected (just Enter). */
-    if(argv[0] == NULL) {
+/* exitflush - flushout when the shell exits; run by exit */
+static void exitflush(void)
+{
+    /* A forked child that exits holds a copy of the shell's buffer,
+     * which the shell itself will write; it must not write it too */
+    if (getpid() != shellpid) {
         return;
     }
+    flushout();
+}
 
-    /* Call builtin_cmd function to check if first word is a built in
-    * command and perform the fucntion. Otherwise enter if_statement.
-    */
-    isCommand = builtin_cmd(argv); 
-    if (!isCommand) {
-
-        /* Empty mask variable that holds blocked signals and add
-        * SIGCHLD to mask. Then block SIGCHLD with sigprocmask.
-        */ 
-        sigemptyset(&mask);
-        sigaddset(&mask, SIGCHLD);
-        sigprocmask(SIG_BLOCK, &mask, NULL);
+/*
+ * inwait - Called before the shell reads more commands: start queued
+ *    jobs that fit and flush, since the read may block, then in event
+ *    mode sleep in the event loop until there is input. While jobs are
+ *    queued it otherwise sleeps in ppoll, since a read restarted after
+ *    SIGCHLD would not let the shell start them until the next line.
+ */
+static int inwait(int wantinput)
+{
+    struct pollfd pfd = { cmdfd, POLLIN, 0 };
+    sigset_t mask, prev;
 
-        /* Keegan driving
-        * Use fork and create a child process, while error checking
-        * if fork failed.
-        */
-        pid = fork(); 
-        if (pid < 0) {
-            unix_error("fork error");
+    startready();
+    flushout();
+    if (eventmode) {
+        return evwait(wantinput);
+    }
+    if (!wantinput || qhead == NULL) {
+        return 1;
+    }
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &mask, &prev);
+    while (qhead != NULL) {
+        if (ppoll(&pfd, 1, NULL, &prev) >= 0 || errno != EINTR) {
+            break;
         }
+        startready();
+    }
+    sigprocmask(SIG_SETMASK, &prev, NULL);
+    return 1;
+}
 
-        /* If in the child process, execute program. */
-        if(pid == 0) {
-
-            /* Change the process group of child as it will ensure only
-            * one process is in the foreground process group. Also
-            * unblock the SIGCHLD.
-            */
-            setpgid(0, 0);
-            sigprocmask(SIG_UNBLOCK, &mask, NULL);
-
-            /* Execute the program in the pathname (first word), and print
-            * error messsage if execve fails and return to top of shell.
-            * 
-            * Cited from B&O pg. 791
-            */
-            if (execve(argv[0], argv, environ) < 0) { // B&O page 791
-                printf("%s: Command not found\n", argv[0]); 
-                exit(1);
-            }
-
-        /* Enter parent process */
-        } else {
+/*
+ * splitpipeline - Cut argv at each pipetok into the argvs of the
+ *    commands of a pipeline, storing each in stages. Returns the
+ *    number of commands, or -1 (after reporting it) if one is empty.
+ */
+static int splitpipeline(char **argv, char ***stages)
+{
+    int i, n = 0;
 
-            /* If we have a foreground job and are able to add the job,
-            * then unblock SIGCHLD and wait for the job to finish
-            */
-            if(!isBG && addjob(jobs, pid, FG, cmdline)) {
-                sigprocmask(SIG_UNBLOCK, &mask, NULL);
-                waitfg(pid);
-
-            /* If we have a background job and are able to add the job,
-            * then print the job info, and unblock sIGCHLD.
-            */
-            } else if(isBG && addjob(jobs, pid, BG, cmdline)) {
-                printf("[%d] (%d) %s", pid2jid(jobs, pid), pid, cmdline);
-                sigprocmask(SIG_UNBLOCK, &mask, NULL);
-
-            /* If no job was able to be added because list is full or
-            * the pid was below 0, then kill process.
-            */
-            } else {
-                if (kill(-pid, SIGINT) < 0) {
-                    unix_error("kill error");
-                }
-            }
+    stages[n++] = argv;
+    for (i = 0; argv[i] != NULL; i++) {
+        if (argv[i] != pipetok) {
+            continue;
+        }
+        if (n == MAXSTAGES) {
+            printf("Too many commands in pipeline\n");
+            return -1;
         }
+        argv[i] = NULL;
+        stages[n++] = &argv[i + 1];
     }
-    return;
+    for (i = 0; i < n; i++) {
+        if (stages[i][0] == NULL) {
+            printf("syntax error near unexpected token `|'\n");
+            return -1;
+        }
+    }
+    return n;
 }
 
-/* 
- * builtin_cmd - If the user has typed a built-in command then execute
- *    it immediately.  
- * Return 1 if a builtin command was executed; return 0
- * if the argument passed in is *not* a builtin command.
+/* isredir - Is tok one of the redirection operators from parseline? */
+static int isredir(const char *tok)
+{
+    return tok == intok || tok == outtok || tok == appendtok
+        || tok == errtok || tok == errappendtok || tok == errouttok;
+}
+
+/*
+ * getredirs - Take the redirections out of the argv of one command,
+ *    storing them in redirs in the order they were written. Returns
+ *    their number, or -1 (after reporting it) if one has no file or
+ *    there are too many.
  */
-int builtin_cmd(char **argv) 
+static int getredirs(char **argv, struct redir_t *redirs)
 {
-    /* Juan driving
-    * Get the first word which may be a built-in command and execute it.
-    * If the first word is "quit", then exit the shell.
-    */
-    char* command = argv[0];
-    if (!strcmp(command, "quit")) {
-        exit(0);
+    struct redir_t *r;
+    char **in, **out, *tok;
+    int n = 0;
+
+    for (in = out = argv; *in != NULL; in++) {
+        tok = *in;
+        if (!isredir(tok)) {
+            *out++ = tok;
+            continue;
+        }
+        if (n == MAXREDIRS) {
+            printf("Too many redirections\n");
+            return -1;
+        }
+        r = &redirs[n++];
+        r->fd = (tok == intok) ? STDIN_FILENO
+              : (tok == outtok || tok == appendtok) ? STDOUT_FILENO
+              : STDERR_FILENO;
+        r->path = NULL;
+        r->flags = 0;
+        r->dupfd = STDOUT_FILENO;
+        if (tok == errouttok) {
+            continue;
+        }
 
-    /* Command to list the jobs. */
-    } else if(!strcmp(argv[0], "jobs")) {
-	    listjobs(jobs);
-	    return 1;
+        /* Every other operator takes the next word as its file. */
+        if (in[1] == NULL || isredir(in[1])) {
+            printf("syntax error near unexpected token `%s'\n",
+                   in[1] ? in[1] : "newline");
+            return -1;
+        }
+        r->path = *++in;
+        r->flags = (tok == intok) ? O_RDONLY
+                 : (tok == appendtok || tok == errappendtok)
+                 ? O_WRONLY | O_CREAT | O_APPEND
+                 : O_WRONLY | O_CREAT | O_TRUNC;
+    }
+    *out = NULL;
+    return n;
+}
 
-    /* Keegan driving
-    * Check if the first word is "bg" or "fg".
-    */
-    } else if(!strcmp(argv[0], "bg") || !strcmp(argv[0], "fg" )) {
+/*
+ * writestats - Append the shell's counters to the file named by
+ *    $MSHSTATS; run at exit
+ */
+static void writestats(void)
+{
+    FILE *fp;
 
-        /* Check if there is second word at all in the array, printing
-        * an error message if there is no second word. If that passes,
-        * then go to the do_bgfg function.
-        */
-        if(argv[1] == NULL) {
-            printf("%s command requires PID or %%jobid argument\n", argv[0]);
-        } else {
-            do_bgfg(argv); 
-        }
-        return 1; 
+    if ((fp = fopen(getenv("MSHSTATS"), "a")) == NULL) {
+        return;
     }
-    return 0;     /* not a builtin command */
+    printstats(fp, jobs.count, jobs.size);
+    fclose(fp);
 }
 
-/* Keegan driving
-* This is a helper function that checks if a particular string is 
-* a number. It is used to make sure fg/bg command line argument
-* can be processed.
-*/
-int isNumber(char* str, int startIndex) {
-    int index = startIndex; 
-    int letterFound = 0; 
-    while (!letterFound && str[index]) {
-        letterFound = !isdigit(str[index]);
-        index++;
+/*
+ * timebuiltin - Run argv if it is a builtin command, or with fast set
+ *    a command runfast takes, then report the time the shell itself
+ *    spent on it. Returns 1 if it ran.
+ */
+static int timebuiltin(char **argv, int fast)
+{
+    struct usage_t u;
+    struct rusage r0, r1;
+
+    memset(&u, 0, sizeof(u));
+    getrusage(RUSAGE_SELF, &r0);
+    clock_gettime(CLOCK_MONOTONIC, &u.start);
+    if (!builtin_cmd(argv) && !(fast && runfast(argv))) {
+        return 0;
     }
-    return !letterFound; 
+    clock_gettime(CLOCK_MONOTONIC, &u.end);
+    getrusage(RUSAGE_SELF, &r1);
+    timersub(&r1.ru_utime, &r0.ru_utime, &u.utime);
+    timersub(&r1.ru_stime, &r0.ru_stime, &u.stime);
+    u.maxrss = r1.ru_maxrss;
+    printusage(&u, 0);
+    return 1;
 }
 
-/* 
- * do_bgfg - Execute the builtin bg and fg commands
+/*
+ * startjob - Start the n commands of a pipeline in one new process
+ *    group, each one's stdout piped to the next one's stdin, and add
+ *    them to the job list as a single job in the given state. Each
+ *    command's own redirections are applied on top of its pipe ends.
+ *    If queued is not NULL it is the queued job being started.
+ *    SIGCHLD must be blocked. Returns the job's pid, or 0 if there is
+ *    no job.
  */
-void do_bgfg(char **argv) 
+static pid_t startjob(char ***stages, const char **paths,
+                      struct redir_t (*redirs)[MAXREDIRS], const int *nredirs,
+                      int n, int state, char *cmdline, struct job_t *queued)
 {
-    /* Keegan driving */
-    struct job_t *jobby;
-    int jid, pidNum, isNum;
-    char first = argv[1][0];
+    struct proc_t proc;
+    struct timespec t0, t1;
+    int i, added, fds[2];
+    pid_t pid, jobpid = 0;
+
+    proc.infd = -1;
+    for (i = 0; i < n; i++) {
+        proc.path = paths[i];
+        proc.argv = stages[i];
+        proc.redirs = redirs[i];
+        proc.nredirs = nredirs[i];
+        proc.pgid = jobpid;
+        proc.outfd = -1;
+        proc.ttyfd = state == FG ? ttyfd : -1;
+        proc.envp = childenv;
+        proc.envgen = childenvgen;
+        if (i < n - 1) {
+            if (pipe2(fds, O_CLOEXEC) < 0) {
+                unix_error("pipe error");
+            }
+            proc.outfd = fds[1];
+        }
 
-    /* Check if the second word is a number. */
-    isNum = first == '%' ? !isNumber(argv[1], 1) : !isNumber(argv[1], 0);
+        /* The child gets the mask the shell was started with. */
+        clock_gettime(CLOCK_MONOTONIC, &t0);
+        pid = launch(&proc, launchmode, &childmask);
+        if (pid < 0) {
+            unix_error("fork error");
+        }
+        clock_gettime(CLOCK_MONOTONIC, &t1);
+        stats.launches++;
+        histadd(&stats.launchus, (t1.tv_sec - t0.tv_sec) * 1000000
+                + (t1.tv_nsec - t0.tv_nsec) / 1000);
+
+        /* The shell's copies of this command's pipe ends must go, or
+        * the readers downstream would never see EOF. The next command
+        * reads from the pipe just made.
+        */
+        if (proc.infd >= 0) {
+            close(proc.infd);
+        }
+        if (proc.outfd >= 0) {
+            close(proc.outfd);
+        }
+        proc.infd = i < n - 1 ? fds[0] : -1;
 
-    /* Error checking, argument after fg/bg command has to be a number */
-    if(isNum) {
-        printf("%s: argument must be a PID or %%jobid\n", argv[0]);
-        return;
-    }
+        /* A command that could not be started was already reported. */
+        if (pid == 0) {
+            stats.launchfail++;
+            continue;
+        }
+        if (eventmode) {
+            evwatchpid(pid);
+        }
 
-    /* If argument following command has a %, it is a jobid and the job
-    * struct must be acquired. If job isn't found then print error
-    * message and exit.
-    */
-    if(first == '%') {
+        /* The first command started leads the job; the rest join it. */
+        added = jobpid ? addproc(&jobs, jobpid, pid)
+              : queued ? runjob(&jobs, queued, pid, state)
+                       : addjob(&jobs, pid, state, cmdline);
+        if (added) {
+            if (jobpid == 0) {
+                jobpid = pid;
+            }
+            if (jobs.count > stats.jobsmax) {
+                stats.jobsmax = jobs.count;
+            }
+            continue;
+        }
 
-        jid = atoi(&argv[1][1]);
-        jobby = getjobjid(jobs, jid);
-        if(jobby == NULL) {
-            printf("%s: No such job\n", argv[1]);
-            return;
+        /* If the job could not be added because memory ran out or the
+        * pid was below 0, then kill what was started and stop.
+        */
+        if (kill(-(jobpid ? jobpid : pid), SIGINT) < 0) {
+            unix_error("kill error");
         }
+        if (proc.infd >= 0) {
+            close(proc.infd);
+        }
+        break;
+    }
 
-    /* Juan driving
-    * Get the job struct with the PID. If the job doesn't exist, print error
-    * message and return to the top of the shell.
-    */
-    } else {
-        pidNum = atoi(argv[1]);
-        jobby = getjobpid(jobs, pidNum);
-        if(jobby == NULL) {
-            printf("(%s): No such process\n", argv[1]);
-            return;
+    /* A queued job none of whose commands started is gone for good. */
+    if (queued != NULL && jobpid == 0) {
+        unqueuejob(&jobs, queued);
+    }
+    return jobpid;
+}
+
+/*
+ * queuecopy - Copy what startjob needs to start a pipeline into one
+ *    block: the words of each command, its redirections and their
+ *    files, and its program, since none of them may outlive the line
+ *    (the arena, a parsed command's words, the command hash). Returns
+ *    the block, or NULL if there is no memory.
+ */
+static struct qjob_t *queuecopy(char ***stages, const char **paths,
+                                struct redir_t (*redirs)[MAXREDIRS],
+                                const int *nredirs, int n)
+{
+    struct qjob_t *q;
+    char **argv, *text;
+    size_t size, len;
+    int i, j, nwords = 0;
+
+    size = sizeof(*q) + n * (sizeof(*q->redirs) + sizeof(char **)
+                             + sizeof(char *) + sizeof(int));
+    for (i = 0; i < n; i++) {
+        for (j = 0; stages[i][j] != NULL; j++) {
+            size += sizeof(char *) + strlen(stages[i][j]) + 1;
+        }
+        nwords += j + 1;
+        size += sizeof(char *) + strlen(paths[i]) + 1;
+        for (j = 0; j < nredirs[i]; j++) {
+            if (redirs[i][j].path != NULL) {
+                size += strlen(redirs[i][j].path) + 1;
+            }
         }
     }
+    if ((q = malloc(size)) == NULL) {
+        return NULL;
+    }
 
-    /* Restart a stopped job by sending the SIGCONT signal. */
-    if (kill(-jobby->pid, SIGCONT) < 0) {
-        unix_error("kill error");
+    q->redirs = (struct redir_t (*)[MAXREDIRS]) (q + 1);
+    q->stages = (char ***) (q->redirs + n);
+    q->paths = (const char **) (q->stages + n);
+    argv = (char **) (q->paths + n);
+    q->nredirs = (int *) (argv + nwords);
+    text = (char *) (q->nredirs + n);
+    q->n = n;
+
+#define COPY(s) (len = strlen(s) + 1, text += len, memcpy(text - len, s, len))
+    for (i = 0; i < n; i++) {
+        q->stages[i] = argv;
+        for (j = 0; stages[i][j] != NULL; j++) {
+            *argv++ = COPY(stages[i][j]);
+        }
+        *argv++ = NULL;
+        q->nredirs[i] = nredirs[i];
+        for (j = 0; j < nredirs[i]; j++) {
+            q->redirs[i][j] = redirs[i][j];
+            if (redirs[i][j].path != NULL) {
+                q->redirs[i][j].path = COPY(redirs[i][j].path);
+            }
+        }
+        q->paths[i] = COPY(paths[i]);
     }
+#undef COPY
+    return q;
+}
 
-    /* Once a job was restarted, if built in command was "bg", then change 
-    * the state to BG and print message. Otherwise change the state to
-    * FG and wait for this new foreground job.
-    */
-    if(!strcmp(argv[0], "bg")) {
-        jobby->state = BG;
-        printf("[%d] (%d) %s", jobby->jid, jobby->pid, jobby->cmdline);
+/*
+ * queuejobline - Queue the background pipeline of cmdline until fewer
+ *    than maxbg jobs are running. SIGCHLD must be blocked.
+ */
+static void queuejobline(char ***stages, const char **paths,
+                         struct redir_t (*redirs)[MAXREDIRS],
+                         const int *nredirs, int n, char *cmdline)
+{
+    struct qjob_t *q;
+
+    if ((q = queuecopy(stages, paths, redirs, nredirs, n)) == NULL) {
+        printf("eval: out of memory\n");
+        return;
+    }
+    if ((q->jid = queuejob(&jobs, n, cmdline)) == 0) {
+        free(q);
+        return;
+    }
+    q->next = NULL;
+    if (qtail != NULL) {
+        qtail->next = q;
     } else {
-        jobby->state = FG;
-        waitfg(jobby->pid);
+        qhead = q;
     }
-
-    return;
+    qtail = q;
+    printf("[%d] (-) Queued %s", q->jid, cmdline);
 }
 
-/* 
- * waitfg - Block until process pid is no longer the foreground process
+/*
+ * startqueued - Take queued job q off the queue and start it in the
+ *    given state, noting a background start in out. SIGCHLD must be
+ *    blocked. Returns the job's pid or 0.
  */
-void waitfg(pid_t pid)
+static pid_t startqueued(struct qjob_t *q, int state, struct sio_t *out)
 {
-    /* Juan driving
-    * Variables describe a set containing signals to be blocked
-    */
-    sigset_t mask, prev;
+    struct qjob_t *p, *prev = NULL;
+    struct job_t *job;
+    pid_t pid;
 
-    /* Empty the mask set and and add SIGCHLD as a signal to be
-    * blocked. Finally block the signal with sigprocmask.
-    */
-    sigemptyset(&mask);
-    sigaddset(&mask, SIGCHLD);
-    sigprocmask(SIG_BLOCK, &mask, &prev);
+    for (p = qhead; p != q; p = p->next) {
+        prev = p;
+    }
+    if (prev != NULL) {
+        prev->next = q->next;
+    } else {
+        qhead = q->next;
+    }
+    if (qtail == q) {
+        qtail = prev;
+    }
 
-    /* Continuously run loop until foreground process is not the
-    * parameter pid. Use sigsuspend to avoid busy waiting and race
-    * conditions by suspending process until child terminates and
-    * avoid being interrupted between while check and sigsuspend.
-    */
-    while(fgpid(jobs) == pid) {
-        sigsuspend(&prev);
+    if ((job = getjobjid(&jobs, q->jid)) == NULL || job->state != QU) {
+        free(q);
+        return 0;
+    }
+    pid = startjob(q->stages, q->paths, q->redirs, q->nredirs, q->n, state,
+                   NULL, job);
+    free(q);
+    if (pid != 0 && state == BG) {
+        sio_puts(out, "[");
+        sio_putl(out, job->jid);
+        sio_puts(out, "] (");
+        sio_putl(out, pid);
+        sio_puts(out, ") ");
+        sio_puts(out, jobcmdline(&jobs, job));
     }
+    return pid;
+}
 
-    /* Unblock SIG_CHLD after child already terminated. */
-    sigprocmask(SIG_UNBLOCK, &mask, NULL);
-    return;
+/*
+ * runqueue - Start queued jobs, oldest first, while fewer than maxbg
+ *    jobs are running in the background. SIGCHLD must be blocked.
+ */
+static void runqueue(struct sio_t *out)
+{
+    while (qhead != NULL && (maxbg == 0 || jobs.nbg < maxbg)) {
+        startqueued(qhead, BG, out);
+    }
 }
 
-/*****************
- * Signal handlers
- *****************/
+
+/* 
+ * eval - Evaluate the command line that the user has just typed in
+ * 
+ * If the user has requested a built-in command (quit, jobs, bg, fg or
+ * hash) then execute it immediately. Otherwise, fork a child process
+ * for each command of the pipeline and run the job in the context of
+ * the children. If the job is running in the foreground, wait for it
+ * to terminate and then return.  Note: each job must have a unique
+ * process group ID so that our background children don't receive
+ * SIGINT (SIGTSTP) from the kernel when we type ctrl-c (ctrl-z) at
+ * the keyboard. All commands of a pipeline share that group.
+ *
+ * A line that is one simple command with nothing to expand goes to
+ * runcmd straight from the arena. Anything else is parsed into a tree
+ * (see ast.c) that runtree runs; a line that leaves a compound
+ * command open is kept in script until the lines that close it come.
+*/
+void eval(char *cmdline, size_t len) 
+{
+    /* Juan driving */
+    struct node_t *tree;
+    int isBG;
+
+    if (script.len > 0) {
+        sbput(&script, cmdline, len);
+        cmdline = script.s;
+        len = script.len;
+    }
+
+    /* Call tokenize to change words of input into argv and save
+    * return value into isBG to know first word is a BG job. The
+    * arena only grows for a line longer than any seen before.
+    */
+    if (arenafit(&arena, len) < 0) {
+        printf("eval: out of memory\n");
+        script.len = 0;
+        return;
+    }
+    if ((isBG = tokenize(cmdline, len, &arena)) < 0) {
+        printf("syntax error: unterminated quote\n");
+        script.len = 0;
+        return;
+    }
+    if (script.len == 0 && arena.plain
+        && (arena.argc == 0 || (!iskeyword(arena.argv[0])
+                                && arena.argv[arena.argc - 1] != pipetok))) {
+        runcmd(arena.argv, isBG, cmdline);
+        return;
+    }
+
+    /* The parser wants the trailing & tokenize took off back. */
+    if (isBG) {
+        arena.argv[arena.argc++] = bgtok;
+        arena.argv[arena.argc] = NULL;
+    }
+    switch (parse(arena.argv, &tree)) {
+    case PARSE_MORE:
+        if (script.len == 0) {
+            sbput(&script, cmdline, len);
+        }
+        return;
+    case PARSE_OK:
+        script.len = 0;
+        interrupted = 0;
+        runtree(tree);
+        freenode(tree);
+        return;
+    }
+    script.len = 0;
+    laststatus = 2;
+}
+
+/*
+ * runcmd - Run the words of one simple command, a pipeline or a
+ *    builtin, in the background if isBG. cmdline is the command line
+ *    the job list shows for it. Sets laststatus.
+ */
+static void runcmd(char **argv, int isBG, char *cmdline)
+{
+    int isCommand, isTimed, isFast, nstages, i;
+    char **stages[MAXSTAGES];
+    const char *paths[MAXSTAGES];
+    struct redir_t redirs[MAXSTAGES][MAXREDIRS];
+    int nredirs[MAXSTAGES];
+    pid_t pid;
+    sigset_t mask, prev;
+
+    /* Return back to shell if no input was detected (just Enter). */
+    if(argv[0] == NULL) {
+        return;
+    }
+
+    /* Words of the form NAME=value on their own set shell variables.
+    * In front of a command they are left as its first words.
+    */
+    laststatus = 0;
+    for (i = 0; argv[i] != NULL && isassign(argv[i]); i++)
+        ;
+    if (i > 0 && argv[i] == NULL) {
+        for (i = 0; argv[i] != NULL; i++) {
+            if (setassign(argv[i], 0) < 0) {
+                printf("%s: out of memory\n", argv[i]);
+                laststatus = 1;
+            }
+        }
+        return;
+    }
+
+    /* "time" in front of a command line reports what the job used
+    * once it is done. A background job is not reported.
+    */
+    isTimed = !strcmp(argv[0], "time");
+    if (isTimed && *++argv == NULL) {
+        printf("time: usage: time command\n");
+        laststatus = 2;
+        return;
+    }
+
+    /* With -b a lone foreground echo, test and the like runs in the
+    * shell; "command" in front runs the program itself instead.
+    */
+    isFast = fastmode && !isBG;
+    if (!strcmp(argv[0], "command")) {
+        isFast = 0;
+        if (*++argv == NULL) {
+            printf("command: usage: command name [args]\n");
+            laststatus = 2;
+            return;
+        }
+    }
+
+    /* Split the words into the commands of a pipeline. */
+    if ((nstages = splitpipeline(argv, stages)) < 0) {
+        laststatus = 2;
+        return;
+    }
+
+    /* Take each command's redirections out of its words. */
+    for (i = 0; i < nstages; i++) {
+        if ((nredirs[i] = getredirs(stages[i], redirs[i])) < 0) {
+            laststatus = 2;
+            return;
+        }
+        if (stages[i][0] == NULL) {
+            printf("syntax error: missing command\n");
+            laststatus = 2;
+            return;
+        }
+    }
+
+    /* parallel is a builtin whose input may be redirected. */
+    if (nstages == 1 && !isTimed && !strcmp(argv[0], "parallel")) {
+        do_parallel(argv, redirs[0], nredirs[0]);
+        return;
+    }
+
+    /* Call builtin_cmd function to check if first word is a built in
+    * command and perform the fucntion. Otherwise enter if_statement.
+    * Builtins only run on their own, never in a pipeline, and their
+    * output cannot be redirected. A builtin's status is 0; runfast
+    * sets the status of what it runs.
+    */
+    isCommand = nstages == 1 && nredirs[0] == 0
+        && (isTimed ? timebuiltin(argv, isFast)
+            : builtin_cmd(argv) || (isFast && runfast(argv)));
+    if (!isCommand) {
+
+        /* A bare command name is looked up on PATH through the command
+        * hash; anything with a slash in it is run as given.
+        */
+        for (i = 0; i < nstages; i++) {
+            paths[i] = stages[i][0];
+            if (strchr(paths[i], '/') == NULL
+                && (paths[i] = pathsearch(paths[i])) == NULL) {
+                printf("%s: Command not found\n", stages[i][0]);
+                laststatus = 127;
+                return;
+            }
+        }
+
+        /* Empty mask variable that holds blocked signals and add
+        * SIGCHLD to mask. Then block SIGCHLD with sigprocmask.
+        */ 
+        sigemptyset(&mask);
+        sigaddset(&mask, SIGCHLD);
+        sigprocmask(SIG_BLOCK, &mask, &prev);
+        updateenv();
+
+        /* With maxbg background jobs already running, or others
+        * waiting before it, a background job joins the queue, to be
+        * started by startready once one of them is done. Jobs done
+        * since the shell last looked make room first.
+        */
+        runqueue(&notes);
+        if (isBG && maxbg > 0 && parnext == NULL
+            && (jobs.nbg >= maxbg || qhead != NULL)) {
+            queuejobline(stages, paths, redirs, nredirs, nstages, cmdline);
+            sigprocmask(SIG_SETMASK, &prev, NULL);
+            return;
+        }
+
+        /* Whatever the shell has printed must come out before the
+        * job's own output, and a forked child must not inherit it.
+        */
+        flushout();
+
+        /* Keegan driving
+        * Start the pipeline as one job, in a new process group.
+        */
+        pid = startjob(stages, paths, redirs, nredirs, nstages,
+                       isBG ? BG : FG, cmdline, NULL);
+
+        /* If nothing could be started or added, there is no job. */
+        if(pid == 0) {
+            sigprocmask(SIG_SETMASK, &prev, NULL);
+            laststatus = 127;
+
+        /* If we have a foreground job, then unblock SIGCHLD and wait
+        * for the job to finish
+        */
+        } else if(!isBG) {
+            sigprocmask(SIG_SETMASK, &prev, NULL);
+            waitfg(pid);
+            laststatus = fgstatus(pid);
+            if (isTimed && jobs.lastfgpid == pid) {
+                printusage(&jobs.lastfg, 0);
+            }
+
+        /* A parallel item is handed to its slot before SIGCHLD is
+        * unblocked, so it cannot finish unseen. Any other background
+        * job gets its job info printed.
+        */
+        } else if (parnext != NULL) {
+            parnext->pid = pid;
+            sigprocmask(SIG_SETMASK, &prev, NULL);
+
+        /* If we have a background job, then print the job info, and
+        * unblock SIGCHLD.
+        */
+        } else {
+            printf("[%d] (%d) %s", pid2jid(&jobs, pid), pid, cmdline);
+            sigprocmask(SIG_SETMASK, &prev, NULL);
+        }
+    }
+    return;
+}
+
+/*
+ * runtree - Run the commands of a tree built by parse. The words of
+ *    each command are expanded again only where a variable they use
+ *    has changed. ctrl-c, or a FG job killed by it, stops the lot.
+ */
+static void runtree(struct node_t *n)
+{
+    char **words;
+    int i, status;
+
+    for (; n != NULL && !interrupted; n = n->next) {
+        switch (n->type) {
+        case N_CMD:
+            words = expandwords(&n->words, laststatus);
+            runcmd(words, n->bg, wordstext(&n->words, n->bg));
+            break;
+
+        case N_AND:
+        case N_OR:
+            runtree(n->left);
+            if (!interrupted && (laststatus == 0) == (n->type == N_AND)) {
+                runtree(n->right);
+            }
+            break;
+
+        case N_NOT:
+            runtree(n->left);
+            laststatus = !laststatus;
+            break;
+
+        case N_IF:
+            runtree(n->left);
+            if (interrupted) {
+                break;
+            }
+            if (laststatus == 0) {
+                runtree(n->right);
+            } else if (n->other != NULL) {
+                runtree(n->other);
+            } else {
+                laststatus = 0;
+            }
+            break;
+
+        /* A loop's status is its body's last, or 0 if it never ran */
+        case N_WHILE:
+        case N_UNTIL:
+            status = 0;
+            while (1) {
+                runtree(n->left);
+                if (interrupted || (laststatus == 0) != (n->type == N_WHILE)) {
+                    break;
+                }
+                runtree(n->right);
+                status = laststatus;
+            }
+            laststatus = status;
+            break;
+
+        case N_FOR:
+            words = expandwords(&n->words, laststatus);
+            laststatus = 0;
+            for (i = 0; words[i] != NULL && !interrupted; i++) {
+                if (setvar(n->name, words[i]) < 0) {
+                    printf("for: out of memory\n");
+                    break;
+                }
+                runtree(n->right);
+            }
+            break;
+        }
+    }
+}
+
+/*
+ * fgstatus - The exit status of FG job pid once waitfg returns: that
+ *    of its last command, 128 plus the signal that killed it, or 128
+ *    plus SIGTSTP if it is stopped. A job killed by SIGINT counts as
+ *    ctrl-c for the shell too, so it stops runtree.
+ */
+static int fgstatus(pid_t pid)
+{
+    int status;
+
+    if (jobs.lastfgpid != pid) {
+        return 128 + SIGTSTP;
+    }
+    status = jobs.lastfgstatus;
+    if (WIFSIGNALED(status)) {
+        if (WTERMSIG(status) == SIGINT) {
+            interrupted = 1;
+        }
+        return 128 + WTERMSIG(status);
+    }
+    return WEXITSTATUS(status);
+}
+
+/* 
+ * builtin_cmd - If the user has typed a built-in command then execute
+ *    it immediately.  
+ * Return 1 if a builtin command was executed; return 0
+ * if the argument passed in is *not* a builtin command.
+ */
+int builtin_cmd(char **argv) 
+{
+    /* Juan driving
+    * Get the first word which may be a built-in command and execute it.
+    * If the first word is "quit", then exit the shell.
+    */
+    char* command = argv[0];
+    if (!strcmp(command, "quit")) {
+        exit(0);
+
+    /* Command to list the jobs. With -l each job also shows the time
+    * and memory it has used so far.
+    */
+    } else if(!strcmp(argv[0], "jobs")) {
+        if (argv[1] == NULL || (!strcmp(argv[1], "-l") && argv[2] == NULL)) {
+            listjobs(&jobs, argv[1] != NULL);
+        } else {
+            printf("jobs: usage: jobs [-l]\n");
+        }
+        return 1;
+
+    /* Keegan driving
+    * Check if the first word is "bg" or "fg".
+    */
+    /* Command to show or set how many BG jobs may run at once. */
+    } else if(!strcmp(argv[0], "bg") && argv[1] != NULL
+              && !strcmp(argv[1], "-j")) {
+        do_bglimit(argv);
+        return 1;
+
+    } else if(!strcmp(argv[0], "bg") || !strcmp(argv[0], "fg" )) {
+
+        /* Check if there is second word at all in the array, printing
+        * an error message if there is no second word. If that passes,
+        * then go to the do_bgfg function.
+        */
+        if(argv[1] == NULL) {
+            printf("%s command requires PID or %%jobid argument\n", argv[0]);
+        } else {
+            do_bgfg(argv); 
+        }
+        return 1; 
+
+    /* Command to show, fill or reset the command hash. */
+    } else if(!strcmp(argv[0], "hash")) {
+        do_hash(argv);
+        return 1;
+
+    /* Command to sleep until background jobs are done. */
+    } else if(!strcmp(argv[0], "wait")) {
+        do_wait(argv);
+        return 1;
+
+    /* Command to print or reset the shell's own counters. */
+    } else if(!strcmp(argv[0], "stats")) {
+        do_stats(argv);
+        return 1;
+
+    /* Commands to export and forget shell variables, and to show the
+    * environment jobs get. env with arguments is the program.
+    */
+    } else if(!strcmp(argv[0], "export")) {
+        do_export(argv);
+        return 1;
+
+    } else if(!strcmp(argv[0], "unset")) {
+        do_unset(argv);
+        return 1;
+
+    } else if(!strcmp(argv[0], "env") && argv[1] == NULL) {
+        do_env();
+        return 1;
+    }
+    return 0;     /* not a builtin command */
+}
+
+/* Keegan driving
+* This is a helper function that checks if a particular string is 
+* a number. It is used to make sure fg/bg command line argument
+* can be processed.
+*/
+int isNumber(char* str, int startIndex) {
+    int index = startIndex; 
+    int letterFound = 0; 
+    while (!letterFound && str[index]) {
+        letterFound = !isdigit(str[index]);
+        index++;
+    }
+    return !letterFound; 
+}
+
+/* 
+ * do_bgfg - Execute the builtin bg and fg commands
+ */
+void do_bgfg(char **argv) 
+{
+    /* Keegan driving */
+    struct job_t *jobby;
+    int jid, pidNum, isNum;
+    char first = argv[1][0];
+
+    /* Check if the second word is a number. */
+    isNum = first == '%' ? !isNumber(argv[1], 1) : !isNumber(argv[1], 0);
+
+    /* Error checking, argument after fg/bg command has to be a number */
+    if(isNum) {
+        printf("%s: argument must be a PID or %%jobid\n", argv[0]);
+        return;
+    }
+
+    /* If argument following command has a %, it is a jobid and the job
+    * struct must be acquired. If job isn't found then print error
+    * message and exit.
+    */
+    if(first == '%') {
+
+        jid = atoi(&argv[1][1]);
+        jobby = getjobjid(&jobs, jid);
+        if(jobby == NULL) {
+            printf("%s: No such job\n", argv[1]);
+            return;
+        }
+
+    /* Juan driving
+    * Get the job struct with the PID. If the job doesn't exist, print error
+    * message and return to the top of the shell.
+    */
+    } else {
+        pidNum = atoi(argv[1]);
+        jobby = getjobpid(&jobs, pidNum);
+        if(jobby == NULL) {
+            printf("(%s): No such process\n", argv[1]);
+            return;
+        }
+    }
+
+    /* A queued job has no processes to continue; start it now,
+    * whatever the limit.
+    */
+    if (jobby->state == QU) {
+        startnow(jobby, !strcmp(argv[0], "bg") ? BG : FG);
+        return;
+    }
+
+    /* Restart a stopped job by sending the SIGCONT signal. One going
+    * to the foreground gets the terminal, and its modes, first.
+    */
+    if (strcmp(argv[0], "bg") && ttyfd >= 0) {
+        givetty(jobby);
+    }
+    if (kill(-jobby->pid, SIGCONT) < 0) {
+        unix_error("kill error");
+    }
+
+    /* Once a job was restarted, if built in command was "bg", then change 
+    * the state to BG and print message. Otherwise change the state to
+    * FG and wait for this new foreground job.
+    */
+    if(!strcmp(argv[0], "bg")) {
+        setjobstate(&jobs, jobby, BG);
+        printf("[%d] (%d) %s", jobby->jid, jobby->pid,
+               jobcmdline(&jobs, jobby));
+    } else {
+        setjobstate(&jobs, jobby, FG);
+        startmore();
+        waitfg(jobby->pid);
+    }
+
+    return;
+}
+
+/*
+ * startnow - Start queued job now in the given state, ahead of the
+ *    queue, waiting for it if it is the FG job.
+ */
+static void startnow(struct job_t *job, int state)
+{
+    struct qjob_t *q;
+    sigset_t mask, prev;
+    pid_t pid;
+
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &mask, &prev);
+    for (q = qhead; q != NULL && q->jid != job->jid; q = q->next)
+        ;
+    flushout();
+    pid = q ? startqueued(q, state, &notes) : 0;
+    flushout();
+    sigprocmask(SIG_SETMASK, &prev, NULL);
+    if (pid != 0 && state == FG) {
+        waitfg(pid);
+    }
+}
+
+/*
+ * startready - Start queued jobs if any now fit under the limit. The
+ *    shell calls this wherever it waits, since sigchld_handler only
+ *    reaps: launch reports a failure with stdio and may posix_spawn,
+ *    neither of which is safe in a handler.
+ */
+static void startready(void)
+{
+    if (qhead != NULL && (maxbg == 0 || jobs.nbg < maxbg)) {
+        startmore();
+    }
+}
+
+/*
+ * startmore - Start whatever queued jobs now fit under the limit,
+ *    after a job left the BG state or the limit went up
+ */
+static void startmore(void)
+{
+    sigset_t mask, prev;
+
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &mask, &prev);
+    flushout();
+    runqueue(&notes);
+    flushout();
+    sigprocmask(SIG_SETMASK, &prev, NULL);
+}
+
+/*
+ * do_bglimit - Execute the builtin bg -j command: with no count print
+ *    the most BG jobs that run at once, otherwise set it (0 for no
+ *    limit) and start any queued jobs that now fit.
+ */
+void do_bglimit(char **argv)
+{
+    if (argv[2] == NULL) {
+        printf("%d\n", maxbg);
+    } else if (isNumber(argv[2], 0) && argv[3] == NULL) {
+        maxbg = atoi(argv[2]);
+        startmore();
+    } else {
+        printf("bg: usage: bg -j [max]\n");
+    }
+}
+
+/*
+ * do_hash - Execute the builtin hash command. With no arguments list
+ *    the remembered command locations, with -r forget them all, and
+ *    otherwise look up and remember each named command.
+ */
+void do_hash(char **argv)
+{
+    int i;
+
+    if (argv[1] == NULL) {
+        listhash();
+        return;
+    }
+    for (i = 1; argv[i] != NULL; i++) {
+        if (!strcmp(argv[i], "-r")) {
+            clearhash();
+        } else if (pathsearch(argv[i]) == NULL) {
+            printf("hash: %s: not found\n", argv[i]);
+        }
+    }
+}
+
+/*
+ * do_stats - Execute the builtin stats command: print the shell's
+ *    counters and histograms, or with -r start them from zero.
+ */
+void do_stats(char **argv)
+{
+    sigset_t mask, prev;
+
+    if (argv[1] == NULL) {
+        printstats(stdout, jobs.count, jobs.size);
+    } else if (!strcmp(argv[1], "-r") && argv[2] == NULL) {
+        /* sigchld_handler counts in the same struct */
+        sigemptyset(&mask);
+        sigaddset(&mask, SIGCHLD);
+        sigprocmask(SIG_BLOCK, &mask, &prev);
+        clearstats();
+        sigprocmask(SIG_SETMASK, &prev, NULL);
+    } else {
+        printf("stats: usage: stats [-r]\n");
+    }
+}
+
+/*
+ * do_export - Execute the builtin export command: put each NAME, or
+ *    NAME=value after setting it, in the environment of jobs. With no
+ *    arguments, list what is exported.
+ */
+void do_export(char **argv)
+{
+    int i, err;
+
+    if (argv[1] == NULL) {
+        listexports();
+        return;
+    }
+    for (i = 1; argv[i] != NULL; i++) {
+        if (isassign(argv[i])) {
+            err = setassign(argv[i], 1);
+        } else if (isname(argv[i], strlen(argv[i]))) {
+            err = exportvar(argv[i]);
+        } else {
+            printf("export: `%s': not a valid identifier\n", argv[i]);
+            laststatus = 1;
+            continue;
+        }
+        if (err < 0) {
+            printf("export: out of memory\n");
+            laststatus = 1;
+        }
+    }
+}
+
+/*
+ * do_unset - Execute the builtin unset command: forget each variable
+ *    named, which leaves the environment of jobs too
+ */
+void do_unset(char **argv)
+{
+    int i;
+
+    for (i = 1; argv[i] != NULL; i++) {
+        if (!isname(argv[i], strlen(argv[i]))) {
+            printf("unset: `%s': not a valid identifier\n", argv[i]);
+            laststatus = 1;
+            continue;
+        }
+        unsetvar(argv[i]);
+    }
+}
+
+/* do_env - Execute the builtin env command: print the environment */
+void do_env(void)
+{
+    sigset_t mask, prev;
+    char **e;
+
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &mask, &prev);
+    updateenv();
+    for (e = childenv; *e != NULL; e++) {
+        printf("%s\n", *e);
+    }
+    sigprocmask(SIG_SETMASK, &prev, NULL);
+}
+
+/*
+ * updateenv - Bring childenv up to date with the exported variables.
+ *    varenv only builds a new envp after one of them has changed, and
+ *    frees the old one when it does.
+ */
+static void updateenv(void)
+{
+    unsigned long gen;
+    char **env;
+
+    if ((env = varenv(&gen)) != NULL && gen != childenvgen) {
+        childenv = env;
+        childenvgen = gen;
+        stats.envbuilds++;
+    }
+}
+
+/*
+ * suspendwhile - Sleep until pending(arg) is false, waking only when
+ *    a signal (or, in event mode, an event) may have changed it, and
+ *    never polling. Returns the number of times it woke.
+ */
+static int suspendwhile(int (*pending)(void *), void *arg)
+{
+    /* Juan driving
+    * Variables describe a set containing signals to be blocked
+    */
+    sigset_t mask, prev;
+    int waits = 0;
+
+    flushout();
+
+    /* In event mode SIGCHLD stays blocked; sleep in the event loop,
+    * which wakes when a child's pidfd or the signalfd has news.
+    */
+    if (eventmode) {
+        startready();
+        while(pending(arg)) {
+            evwait(0);
+            waits++;
+            startready();
+        }
+        return waits;
+    }
+
+    /* Empty the mask set and and add SIGCHLD as a signal to be
+    * blocked. Finally block the signal with sigprocmask. SIGINT and
+    * SIGALRM are held off too, as pending may look at what their
+    * handlers do.
+    */
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGALRM);
+    sigprocmask(SIG_BLOCK, &mask, &prev);
+
+    /* Continuously run loop until the condition no longer holds. Use
+    * sigsuspend to avoid busy waiting and race conditions by
+    * suspending process until child terminates and avoid being
+    * interrupted between while check and sigsuspend. A job done
+    * may let a queued one start, which could be what pending awaits.
+    */
+    startready();
+    while(pending(arg)) {
+        sigsuspend(&prev);
+        waits++;
+        startready();
+    }
+
+    /* Unblock SIG_CHLD after child already terminated. */
+    sigprocmask(SIG_SETMASK, &prev, NULL);
+    return waits;
+}
+
+/* fgpending - Is the job led by *(pid_t *) arg still in the foreground? */
+static int fgpending(void *arg)
+{
+    return fgpid(&jobs) == *(pid_t *) arg;
+}
+
+/*
+ * A wait builtin's jobs: the JIDs it names, or none for every job,
+ * and whether it returns as soon as one of them is done.
+ */
+struct waitset_t {
+    int any;                /* return on the first job done (-n) */
+    int done0;              /* jobsdone when the wait began */
+    int n;                  /* JIDs named */
+    int *jids;              /* room for one per operand */
+};
+
+/* jobrunning - Is job jid running, or queued to run? */
+static int jobrunning(int jid)
+{
+    struct job_t *job = getjobjid(&jobs, jid);
+
+    return job != NULL && (job->state == BG || job->state == QU);
+}
+
+/* waitpending - Should the wait for waitset arg go on? */
+static int waitpending(void *arg)
+{
+    struct waitset_t *w = arg;
+    int i, left = 0;
+
+    if (interrupted) {
+        return 0;
+    }
+    if (w->n == 0) {
+        return (jobs.nbg > 0 || qhead != NULL)
+            && !(w->any && jobsdone != w->done0);
+    }
+    for (i = 0; i < w->n; i++) {
+        left += jobrunning(w->jids[i]);
+    }
+    return w->any ? left == w->n : left > 0;
+}
+
+/*
+ * do_wait - Execute the builtin wait command: sleep until the jobs
+ *    named by %jobid or PID, or every background job, are done, or
+ *    with -n until the first of them is. Stopped jobs are not waited
+ *    for, as they would never finish. ctrl-c ends the wait.
+ */
+void do_wait(char **argv)
+{
+    struct waitset_t w;
+    struct job_t *job;
+    int i = 1;
+
+    /* A line can have any number of words, so neither can a wait */
+    for (i = 1; argv[i] != NULL; i++) {
+        ;
+    }
+    if ((w.jids = malloc(i * sizeof(int))) == NULL) {
+        unix_error("malloc error");
+    }
+    w.any = argv[1] != NULL && !strcmp(argv[1], "-n");
+    w.n = 0;
+    for (i = 1 + w.any; argv[i] != NULL; i++) {
+        if (argv[i][0] == '%' && argv[i][1] != '\0' && isNumber(argv[i], 1)) {
+            if ((job = getjobjid(&jobs, atoi(&argv[i][1]))) == NULL) {
+                printf("%s: No such job\n", argv[i]);
+                continue;
+            }
+        } else if (isNumber(argv[i], 0) && argv[i][0] != '\0') {
+            if ((job = getjobpid(&jobs, atoi(argv[i]))) == NULL) {
+                printf("(%s): No such process\n", argv[i]);
+                continue;
+            }
+        } else {
+            printf("wait: usage: wait [-n] [%%jobid | pid ...]\n");
+            free(w.jids);
+            return;
+        }
+        w.jids[w.n++] = job->jid;
+    }
+    if (w.n > 0 || argv[1 + w.any] == NULL) {
+        interrupted = 0;
+        w.done0 = jobsdone;
+        suspendwhile(waitpending, &w);
+    }               /* else none of the named jobs exist */
+    free(w.jids);
+}
+
+/*
+ * napping - Should a nap ending at *(struct timespec *) arg go on?
+ *    If so, set the timer to wake the shell when it is over.
+ */
+static int napping(void *arg)
+{
+    struct timespec *end = arg, now;
+    struct itimerval it;
+    long ns;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    ns = (end->tv_sec - now.tv_sec) * 1000000000L + end->tv_nsec - now.tv_nsec;
+    if (interrupted || ns <= 0) {
+        return 0;
+    }
+    memset(&it, 0, sizeof(it));
+    it.it_value.tv_sec = ns / 1000000000L;
+    it.it_value.tv_usec = (ns % 1000000000L + 999) / 1000;
+    setitimer(ITIMER_REAL, &it, NULL);
+    return 1;
+}
+
+/*
+ * nap - Sleep secs seconds for a sleep command run by the shell (-b).
+ *    Jobs are still reaped meanwhile, and ctrl-c ends the nap. Returns
+ *    0, or SIGINT if it was cut short.
+ */
+static int nap(double secs)
+{
+    struct timespec end;
+    struct itimerval off;
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    end.tv_sec += (time_t) secs;
+    end.tv_nsec += (long) ((secs - (time_t) secs) * 1e9);
+    if (end.tv_nsec >= 1000000000L) {
+        end.tv_sec++;
+        end.tv_nsec -= 1000000000L;
+    }
+    interrupted = 0;
+    suspendwhile(napping, &end);
+    memset(&off, 0, sizeof(off));
+    setitimer(ITIMER_REAL, &off, NULL);
+    return interrupted ? SIGINT : 0;
+}
+
+/*
+ * runfast - With -b, run argv in the shell if it is a program that
+ *    fastcmd.c has a version of. A bare name counts only if PATH finds
+ *    the program where fastlookup expects it. Returns 1 if it ran,
+ *    with its exit status in laststatus.
+ */
+static int runfast(char **argv)
+{
+    const char *path = argv[0];
+    fastcmd_t *run;
+    int status;
+
+    if (strchr(path, '/') == NULL && (path = pathsearch(path)) == NULL) {
+        return 0;
+    }
+    if ((run = fastlookup(path)) == NULL
+        || (status = run(argv)) == FAST_DECLINE) {
+        return 0;
+    }
+    laststatus = status;
+    stats.inshell++;
+    return 1;
+}
+
+/* sbput - Append the n bytes at s to b */
+static void sbput(struct strbuf_t *b, const char *s, size_t n)
+{
+    while (b->len + n + 1 > b->size) {
+        b->size = b->size ? b->size * 2 : MAXLINE;
+        if ((b->s = realloc(b->s, b->size)) == NULL) {
+            unix_error("realloc error");
+        }
+    }
+    memcpy(b->s + b->len, s, n);
+    b->len += n;
+    b->s[b->len] = '\0';
+}
+
+/* sbquote - Append the n bytes at s to b, for inside single quotes */
+static void sbquote(struct strbuf_t *b, const char *s, size_t n)
+{
+    const char *q;
+
+    while ((q = memchr(s, '\'', n)) != NULL) {
+        sbput(b, s, q - s);
+        sbput(b, "'\\''", 4);
+        n -= q + 1 - s;
+        s = q + 1;
+    }
+    sbput(b, s, n);
+}
+
+/*
+ * parfinish - Note that the job led by pid is done with the given
+ *    wait status, if it is a parallel item. Called by sigchld_handler,
+ *    also for a job that stops: it would never finish, so its slot is
+ *    given up as do_wait gives up waiting for it.
+ */
+static void parfinish(pid_t pid, int status)
+{
+    int i;
+
+    for (i = 0; i < parn; i++) {
+        if (paritems[i].pid == pid && !paritems[i].done) {
+            paritems[i].status = status;
+            paritems[i].done = 1;
+            return;
+        }
+    }
+}
+
+/* parbusy - How many parallel items are still running? */
+static int parbusy(void)
+{
+    int i, n = 0;
+
+    for (i = 0; i < parn; i++) {
+        n += paritems[i].pid != 0 && !paritems[i].done;
+    }
+    return n;
+}
+
+/* parfull - Should parallel wait for a slot? arg is the slots to keep free */
+static int parfull(void *arg)
+{
+    return !interrupted && parbusy() > parn - *(int *) arg;
+}
+
+/*
+ * parreport - Print the exit status of each parallel item that is
+ *    done, free its slot, and count those that failed in *failed
+ */
+static void parreport(long *failed)
+{
+    struct paritem_t *it;
+    int st;
+
+    for (it = paritems; it < paritems + parn; it++) {
+        if (it->pid == 0 || !it->done) {
+            continue;
+        }
+        st = it->status;
+        if (WIFEXITED(st)) {
+            printf("[%ld] exit %d  %s\n", it->seq, WEXITSTATUS(st), it->line);
+        } else if (WIFSTOPPED(st)) {
+            printf("[%ld] stopped %d  %s\n", it->seq, WSTOPSIG(st), it->line);
+        } else {
+            printf("[%ld] signal %d  %s\n", it->seq, WTERMSIG(st), it->line);
+        }
+        *failed += !WIFEXITED(st) || WEXITSTATUS(st) != 0;
+        free(it->line);
+        it->line = NULL;
+        it->pid = 0;
+        it->done = 0;
+    }
+}
+
+/*
+ * do_parallel - Execute the builtin parallel [-j N] cmd [args] command,
+ *    whose input must be redirected from a file: run cmd once for
+ *    each non-empty line, with every {} in its words replaced by the
+ *    line (or the line added as a last argument if there is no {}),
+ *    keeping N running at once (default one per CPU). Each item goes
+ *    through eval as a background job, with its words quoted, and its
+ *    exit status is printed when it is done; a summary line follows.
+ *    An item that stops is reported and counted as failed, and left
+ *    on the job list. ctrl-c stops starting new items.
+ */
+void do_parallel(char **argv, struct redir_t *redirs, int nredirs)
+{
+    struct strbuf_t cmd = { NULL, 0, 0 };
+    struct input_t in;
+    struct timespec t0, t1;
+    char **words, *line, *p, *w;
+    size_t len, size = 0;
+    int i, n, fd, first = 1, braces = 0, one = 1, all;
+    long seq = 0, started = 0, failed = 0;
+    double secs;
+
+    n = sysconf(_SC_NPROCESSORS_ONLN);
+    if (argv[1] != NULL && !strcmp(argv[1], "-j")) {
+        if (argv[2] == NULL || !isNumber(argv[2], 0) || atoi(argv[2]) < 1) {
+            argv[1] = NULL;     /* fall through to the usage message */
+        } else {
+            n = atoi(argv[2]);
+            first = 3;
+        }
+    }
+    if (argv[1] == NULL || argv[first] == NULL || nredirs != 1
+        || redirs[0].fd != STDIN_FILENO || redirs[0].path == NULL) {
+        printf("parallel: usage: parallel [-j N] command [args] < file\n");
+        return;
+    }
+    if ((fd = open(redirs[0].path, O_RDONLY | O_CLOEXEC)) < 0) {
+        printf("%s: %s\n", redirs[0].path, strerror(errno));
+        return;
+    }
+
+    /* Running the items reuses the arena, so the words are copied. */
+    for (i = first; argv[i] != NULL; i++) {
+        size += sizeof(char *) + strlen(argv[i]) + 1;
+        braces |= strstr(argv[i], "{}") != NULL;
+    }
+    if ((words = malloc(size + sizeof(char *))) == NULL
+        || (paritems = calloc(n, sizeof(struct paritem_t))) == NULL) {
+        unix_error("malloc error");
+    }
+    p = (char *) (words + (i - first + 1));
+    for (i = first; argv[i] != NULL; i++) {
+        words[i - first] = strcpy(p, argv[i]);
+        p += strlen(p) + 1;
+    }
+    words[i - first] = NULL;
+
+    parn = n;
+    inopenfd(&in, fd);
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    interrupted = 0;
+    while (!interrupted && (line = inreadline(&in, &len)) != NULL) {
+        if (--len == 0) {
+            continue;
+        }
+        seq++;
+
+        /* Wait for a free slot, then build the item's command line. */
+        suspendwhile(parfull, &one);
+        parreport(&failed);
+        if (interrupted) {
+            break;
+        }
+        cmd.len = 0;
+        for (i = 0; words[i] != NULL; i++) {
+            sbput(&cmd, "'", 1);
+            for (w = words[i]; (p = strstr(w, "{}")) != NULL; w = p + 2) {
+                sbquote(&cmd, w, p - w);
+                sbquote(&cmd, line, len);
+            }
+            sbquote(&cmd, w, strlen(w));
+            sbput(&cmd, "' ", 2);
+        }
+        if (!braces) {
+            sbput(&cmd, "'", 1);
+            sbquote(&cmd, line, len);
+            sbput(&cmd, "' ", 2);
+        }
+        sbput(&cmd, "&\n", 2);
+
+        for (parnext = paritems; parnext->pid != 0; parnext++)
+            ;
+        eval(cmd.s, cmd.len);
+        if (parnext->pid == 0) {
+            printf("[%ld] not started  %.*s\n", seq, (int) len, line);
+            failed++;
+        } else {
+            parnext->seq = seq;
+            parnext->line = strndup(line, len);
+            started++;
+        }
+        parnext = NULL;
+    }
+    inclose(&in);
+
+    /* Then wait for the rest. */
+    all = n;
+    suspendwhile(parfull, &all);
+    parreport(&failed);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+    printf("parallel: %ld items, %ld failed, %.3fs, %.1f items/s\n", seq,
+           failed, secs, secs > 0 ? started / secs : 0.0);
+    if (interrupted) {
+        printf("parallel: interrupted, %d items left running\n", parbusy());
+    }
+
+    /* Items still running after ctrl-c are ordinary background jobs. */
+    parn = 0;
+    for (i = 0; i < n; i++) {
+        free(paritems[i].line);
+    }
+    free(paritems);
+    paritems = NULL;
+    free(words);
+    free(cmd.s);
+}
+
+/*
+ * ttyinit - If the shell reads commands from a terminal, give it its
+ *    own process group and make that the terminal's foreground group,
+ *    so jobs can be handed the terminal in turn. A shell started in
+ *    the background stops itself until it is brought to the front.
+ *    Otherwise, as under sdriver.pl, ttyfd stays -1 and the signal
+ *    handlers relay ctrl-c and ctrl-z to the FG job.
+ */
+static void ttyinit(void)
+{
+    pid_t pgid;
+
+    if (!isatty(STDIN_FILENO)) {
+        return;
+    }
+    while (tcgetpgrp(STDIN_FILENO) != (pgid = getpgrp())) {
+        kill(-pgid, SIGTTIN);
+    }
+    Signal(SIGTTIN, SIG_IGN);
+    Signal(SIGTTOU, SIG_IGN);
+    setpgid(0, 0);
+    shellpgid = getpgrp();
+    if (tcsetpgrp(STDIN_FILENO, shellpgid) < 0
+        || tcgetattr(STDIN_FILENO, &shelltmodes) < 0) {
+        return;
+    }
+    ttyfd = STDIN_FILENO;
+}
+
+/*
+ * givetty - Make job the terminal's foreground group, with the modes
+ *    it had when it stopped. The kernel then sends it ctrl-c and
+ *    ctrl-z itself, without going through the shell.
+ */
+static void givetty(struct job_t *job)
+{
+    if (job->hastmodes) {
+        tcsetattr(ttyfd, TCSADRAIN, &job->tmodes);
+    }
+    tcsetpgrp(ttyfd, job->pid);
+}
+
+/*
+ * taketty - Take the terminal back from the job led by pid. If it
+ *    stopped, its modes are kept for fg and the shell's put back; if
+ *    it exited, the modes it left (say, from stty) become the shell's.
+ *    A job killed by a signal may have left them in any state, so the
+ *    shell's are put back then too.
+ */
+static void taketty(pid_t pid)
+{
+    struct job_t *job;
+    sigset_t mask, prev;
+
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &mask, &prev);
+    if ((job = getjobpid(&jobs, pid)) != NULL) {
+        if (job->state == ST) {
+            job->hastmodes = tcgetattr(ttyfd, &job->tmodes) == 0;
+        }
+    } else if (jobs.lastfgpid == pid && WIFEXITED(jobs.lastfgstatus)) {
+        tcgetattr(ttyfd, &shelltmodes);
+    }
+    sigprocmask(SIG_SETMASK, &prev, NULL);
+    tcsetpgrp(ttyfd, shellpgid);
+    tcsetattr(ttyfd, TCSADRAIN, &shelltmodes);
+}
+
+/* 
+ * waitfg - Block until process pid is no longer the foreground process,
+ *    then take back the terminal if it had it
+ */
+void waitfg(pid_t pid)
+{
+    int waits;  /* wakeups; only the last finds the job done */
+
+    waits = suspendwhile(fgpending, &pid);
+    stats.wakeups += waits;
+    stats.useful += waits > 0;
+    if (ttyfd >= 0) {
+        taketty(pid);
+    }
+}
+
+/*****************
+ * Signal handlers
+ *****************/
+
+/*
+ * jobmsg - Append "Job [jid] (pid) <what> by signal <sig>" to out
+ */
+static void jobmsg(struct sio_t *out, struct job_t *job, const char *what,
+                   int sig)
+{
+    sio_puts(out, "Job [");
+    sio_putl(out, job->jid);
+    sio_puts(out, "] (");
+    sio_putl(out, job->pid);
+    sio_puts(out, ") ");
+    sio_puts(out, what);
+    sio_puts(out, " by signal ");
+    sio_putl(out, sig);
+    sio_puts(out, "\n");
+}
 
 /* 
  * sigchld_handler - The kernel sends a SIGCHLD to the shell whenever
@@ -377,65 +2004,94 @@ void sigchld_handler(int sig)
     /* Juan driving 
     * Influenced by eval function in B&O pg. 809
     */
-    pid_t pid;
-    int status;
+    pid_t pid, leader;
+    int status, nreaped = 0, olderrno = errno;
     struct job_t *jobby;
-    char str[100];
-    const int STDOUT = 1;
-     
-    /* This while loop continues until any child process has changed
-    * its state. If a child has changed its state to stop, the program
-    * changes its state in jobs and exits to the command line. Otherwise
-    * the program continues to wait and to delete zombie children.
+    struct rusage ru;
+
+    /* Signals do not queue, so one SIGCHLD may stand for many children.
+    * Keep collecting state changes until none are left, stopped ones
+    * included, and gather the messages into one buffer so the whole
+    * burst costs a single write. wait4 also hands back what each
+    * finished process used, which is added up per job.
     */
-    while((pid = waitpid(-1, &status, WNOHANG | WUNTRACED)) > 0) {
+    stats.sigchld++;
+    while((pid = wait4(-1, &status, WNOHANG | WUNTRACED, &ru)) > 0) {
+        if (WIFSTOPPED(status)) {
+            stats.stopped++;
+        } else {
+            nreaped++;
+        }
 
-        jobby = getjobpid(jobs, pid);
+        /* A child we never added (addjob failed) has nothing to update */
+        if ((jobby = getjobpid(&jobs, pid)) == NULL) {
+            continue;
+        }
 
-        /* If pid is a process that has terminated, then print message out
-        * and delete job.
+        /* If pid is a process that stopped, then note it and change its
+        * state. It stays on the job list. A pipeline stops as a group,
+        * so only its first stopped process is reported.
         */
-        if(WIFSIGNALED(status)) {
-            sprintf(str, "Job [%d] (%d) terminated by signal %d\n", 
-                jobby->jid, pid, WTERMSIG(status));
-            if(write(STDOUT, str, strlen(str)) != strlen(str)) {
-                exit(-999);
+        if(WIFSTOPPED(status)) {
+            if (jobby->state != ST) {
+                jobmsg(&notes, jobby, "stopped", WSTOPSIG(status));
+                setjobstate(&jobs, jobby, ST);
+                parfinish(jobby->pid, status);
             }
+            continue;
+        }
 
-        /* If pid is a process that stopped, then print message out,
-        * change status, and return to top of shell loop.
+        /* If pid is a process that has terminated by a signal, note it.
+        * A pipeline is reported by its last command, like its status.
+        * Either way the process is finished; the job is deleted once
+        * all of its processes are.
         */
-        } else if(WIFSTOPPED(status)) {
-            sprintf(str, "Job [%d] (%d) stopped by signal %d\n", 
-                jobby->jid, pid, WSTOPSIG(status));
-            if(write(STDOUT, str, strlen(str)) != strlen(str)) {
-                exit(-999);
-            }
-            jobby->state = ST;
-            return;
+        if(WIFSIGNALED(status) && pid == jobby->lastpid) {
+            jobmsg(&notes, jobby, "terminated", WTERMSIG(status));
+        }
+        if (pid == jobby->lastpid) {
+            jobby->status = status;
+        }
+        leader = jobby->pid;
+        status = jobby->status;
+        if (reapproc(&jobs, pid, &ru)) {
+            jobsdone++;
+            parfinish(leader, status);
         }
+    }
+
+    stats.reaped += nreaped;
+    histadd(&stats.perchld, nreaped);
 
-        /* Delete jobs that have been terminated. */
-        deletejob(jobs, pid);
+    /* Output the shell printed before now, but has not flushed yet,
+    * must come first; then the notices wait for flushout.
+    */
+    if (__fpending(stdout) == 0) {
+        sio_flush(&notes);
     }
+    errno = olderrno;
     return;
 }
 
 /* 
  * sigint_handler - The kernel sends a SIGINT to the shell whenver the
  *    user types ctrl-c at the keyboard.  Catch it and send it along
- *    to the foreground job.  
+ *    to the foreground job.  On a terminal the job has been handed
+ *    (see givetty), the kernel signals the job itself and this only
+ *    sees ctrl-c typed while the shell is in front.
  */
 void sigint_handler(int sig) 
 {
     /* Keegan driving 
     * Get the pid of the foreground job and send the SIGINT signal
     */
-    pid_t pid = fgpid(jobs);
+    pid_t pid = fgpid(&jobs);
     if (pid) {
         if (kill(-pid, sig) < 0) {
             unix_error("kill error");
         }
+    } else {
+        interrupted = 1;    /* stops a wait builtin instead */
     }
     return;
 }
@@ -451,7 +2107,7 @@ void sigtstp_handler(int sig)
     * Get the pid of the foreground job and send the SIGTSTP signal
     * if a foreground job exists.
     */
-    pid_t pid = fgpid(jobs);
+    pid_t pid = fgpid(&jobs);
     if(pid) {
         if (kill(-pid, sig) < 0) {
             unix_error("kill error");
@@ -460,6 +2116,34 @@ void sigtstp_handler(int sig)
     return;
 }
 
+/*
+ * sigalrm_handler - Only wakes the shell; see nap.
+ */
+void sigalrm_handler(int sig)
+{
+    return;
+}
+
+/*
+ * evdispatch - In event mode, the event loop hands each signal it
+ *     reads from the signalfd (and each child exit it sees on a pidfd,
+ *     as SIGCHLD) to the handler that would otherwise have run async.
+ */
+void evdispatch(int sig)
+{
+    switch (sig) {
+    case SIGCHLD:
+        sigchld_handler(sig);
+        break;
+    case SIGINT:
+        sigint_handler(sig);
+        break;
+    case SIGTSTP:
+        sigtstp_handler(sig);
+        break;
+    }
+}
+
 /*********************
  * End signal handlers
  *********************/
@@ -475,10 +2159,16 @@ void sigtstp_handler(int sig)
  */
 void usage(void) 
 {
-    printf("Usage: shell [-hvp]\n");
+    printf("Usage: shell [-hvpsSeb] [-j max] [-c commands | script]\n");
     printf("   -h   print this message\n");
     printf("   -v   print additional diagnostic information\n");
     printf("   -p   do not emit a command prompt\n");
+    printf("   -s   start jobs with posix_spawn instead of fork\n");
+    printf("   -S   start jobs from a small spawn server process\n");
+    printf("   -e   handle signals from an epoll loop, not async handlers\n");
+    printf("   -b   run echo, printf, test, true, ... in-process\n");
+    printf("   -j   queue background jobs beyond max running at once\n");
+    printf("   -c   run the commands given, one per line, and exit\n");
     exit(1);
 }
 
@@ -0,0 +1,194 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include "util.h"
+#include "pathcache.h"
+#include "vars.h"
+
+/*
+ * The command hash remembers where each bare command name was found
+ * on PATH, like the hash builtin in bash, so a command only walks the
+ * PATH directories the first time it is run. A hit costs one access()
+ * to make sure the file is still there; if it is not, the entry is
+ * dropped and PATH is searched again. The whole table is thrown away
+ * whenever PATH is different from the value it was built for.
+ */
+
+struct hashent_t {              /* A remembered command */
+    struct hashent_t *next;     /* next entry in the same bucket */
+    char *name;                 /* command name as typed */
+    char *path;                 /* where it was found */
+    int hits;                   /* times it was looked up */
+};
+
+static struct hashent_t **buckets; /* chained hash table */
+static int nbuckets;               /* number of buckets (power of 2) */
+static int nentries;               /* number of entries */
+static char *hashpath;             /* PATH the table was built for */
+
+
+/* strhash - Hash a command name */
+static unsigned int strhash(const char *s)
+{
+    unsigned int h = 5381;
+
+    while (*s)
+	h = h * 33 + (unsigned char) *s++;
+    return h;
+}
+
+/* isexec - Is path an executable regular file? */
+static int isexec(const char *path)
+{
+    struct stat st;
+
+    return stat(path, &st) == 0 && S_ISREG(st.st_mode)
+	&& access(path, X_OK) == 0;
+}
+
+/* searchpath - Return a malloc'd path to name on PATH, NULL if none */
+static char *searchpath(const char *name, const char *path)
+{
+    const char *dir = path, *end;
+    char *buf;
+    int dirlen, namelen = strlen(name);
+
+    if ((buf = malloc(strlen(path) + namelen + 3)) == NULL)
+	return NULL;
+    do {
+	end = strchr(dir, ':');
+	dirlen = end ? end - dir : strlen(dir);
+
+	/* An empty PATH entry means the current directory */
+	if (dirlen == 0) {
+	    buf[0] = '.';
+	    dirlen = 1;
+	} else {
+	    memcpy(buf, dir, dirlen);
+	}
+	buf[dirlen] = '/';
+	memcpy(buf + dirlen + 1, name, namelen + 1);
+	if (isexec(buf))
+	    return buf;
+	dir = end + 1;
+    } while (end);
+
+    free(buf);
+    return NULL;
+}
+
+/* growhash - Double the number of buckets */
+static void growhash(void)
+{
+    struct hashent_t **old = buckets, *e, *next;
+    int i, oldn = nbuckets;
+
+    nbuckets = oldn ? oldn * 2 : 64;
+    if ((buckets = calloc(nbuckets, sizeof(*buckets))) == NULL)
+	unix_error("growhash error");
+    for (i = 0; i < oldn; i++) {
+	for (e = old[i]; e; e = next) {
+	    next = e->next;
+	    e->next = buckets[strhash(e->name) & (nbuckets - 1)];
+	    buckets[strhash(e->name) & (nbuckets - 1)] = e;
+	}
+    }
+    free(old);
+}
+
+/* freeent - Release one entry */
+static void freeent(struct hashent_t *e)
+{
+    free(e->name);
+    free(e->path);
+    free(e);
+}
+
+/* clearhash - Forget every remembered command */
+void clearhash(void)
+{
+    struct hashent_t *e, *next;
+    int i;
+
+    for (i = 0; i < nbuckets; i++) {
+	for (e = buckets[i]; e; e = next) {
+	    next = e->next;
+	    freeent(e);
+	}
+	buckets[i] = NULL;
+    }
+    nentries = 0;
+}
+
+/*
+ * pathsearch - Return the full path of command name, searching PATH
+ *     only if it is not already in the hash. Returns NULL if name is
+ *     not an executable on PATH. The result is owned by the hash and
+ *     is good until the next call.
+ */
+const char *pathsearch(const char *name)
+{
+    const char *path = getvar("PATH");
+    struct hashent_t **pe, *e;
+    char *found;
+
+    if (path == NULL)
+	path = DEFPATH;
+
+    /* A different PATH makes every entry suspect */
+    if (hashpath == NULL || strcmp(hashpath, path) != 0) {
+	clearhash();
+	free(hashpath);
+	if ((hashpath = strdup(path)) == NULL)
+	    unix_error("pathsearch error");
+    }
+    if (nbuckets == 0)
+	growhash();
+
+    pe = &buckets[strhash(name) & (nbuckets - 1)];
+    for (; (e = *pe) != NULL; pe = &e->next) {
+	if (strcmp(e->name, name) != 0)
+	    continue;
+	if (access(e->path, X_OK) == 0) {
+	    e->hits++;
+	    return e->path;
+	}
+	/* The file moved or went away; search again */
+	*pe = e->next;
+	freeent(e);
+	nentries--;
+	break;
+    }
+
+    if ((found = searchpath(name, path)) == NULL)
+	return NULL;
+    if ((e = malloc(sizeof(*e))) == NULL || (e->name = strdup(name)) == NULL)
+	unix_error("pathsearch error");
+    e->path = found;
+    e->hits = 1;
+    if (++nentries > nbuckets * 2)
+	growhash();
+    pe = &buckets[strhash(name) & (nbuckets - 1)];
+    e->next = *pe;
+    *pe = e;
+    return e->path;
+}
+
+/* listhash - Print the remembered commands, in the format of bash */
+void listhash(void)
+{
+    struct hashent_t *e;
+    int i;
+
+    if (nentries == 0) {
+	printf("hash: hash table empty\n");
+	return;
+    }
+    printf("hits\tcommand\n");
+    for (i = 0; i < nbuckets; i++)
+	for (e = buckets[i]; e; e = e->next)
+	    printf("%4d\t%s\n", e->hits, e->path);
+}
@@ -0,0 +1,10 @@
+#ifndef _PATHCACHE_H_
+#define _PATHCACHE_H_
+
+#define DEFPATH "/bin:/usr/bin"   /* search path when PATH is unset */
+
+const char *pathsearch(const char *name);
+void listhash(void);
+void clearhash(void);
+
+#endif
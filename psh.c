@@ -73,21 +73,19 @@ int main(int argc, char **argv)
     while (1) {
 
 	/* Read command line */
-	if (emit_prompt) {
+	/* stdout is line buffered on a terminal and fully buffered
+	 * otherwise; flush only before blocking for input or forking */
+	if (emit_prompt)
 	    printf("%s", prompt);
-	    fflush(stdout);
-	}
+	fflush(stdout);
 	if ((fgets(cmdline, MAXLINE, stdin) == NULL) && ferror(stdin))
 	    app_error("fgets error");
 	if (feof(stdin)) { /* End of file (ctrl-d) */
-	    fflush(stdout);
 	    exit(0);
 	}
 
 	/* Evaluate the command line */
 	eval(cmdline);
-	fflush(stdout);
-	fflush(stdout);
     } 
 
     exit(0); /* control never reaches here */
@@ -128,8 +126,10 @@ void eval(char *cmdline)
     if (!isCommand) {
 
         /* Juan driving
-        * Create a child process and save the pid.
+        * Create a child process and save the pid. Flush first so the
+        * child does not inherit, and later repeat, buffered output.
         */
+        fflush(stdout);
         pid = fork();
 
         /* If we are in the child process we should execute the file.
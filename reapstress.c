@@ -0,0 +1,171 @@
+/*
+ * reapstress.c - Check that the shell reaps every child it starts
+ *
+ * usage: reapstress [-n <jobs>] <shell> [shell args...]
+ * Feeds the shell <jobs> short-lived background jobs as fast as it
+ * will take them, with a job that stops itself every so often and at
+ * the tail of the burst. It then watches /proc until the shell has no
+ * running children left and fails if any of them are zombies, which
+ * is what a reaper that misses part of a SIGCHLD burst leaves behind.
+ * Finally it asks for "jobs" and checks that only the stopped jobs
+ * are still listed.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <signal.h>
+#include <dirent.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "util.h"
+#include "spawnsrv.h"
+
+#define STOPEVERY 100   /* every STOPEVERY-th job stops itself */
+#define TIMEOUT   10    /* seconds to wait for the shell to settle */
+
+/*
+ * scanchildren - Count the children of ppid that are zombies, and
+ *     those that are still running (neither zombie nor stopped). The
+ *     shell's spawn server (msh -S) is not one of its jobs.
+ */
+static void scanchildren(pid_t ppid, int *zombies, int *running)
+{
+    DIR *dir;
+    struct dirent *de;
+    FILE *fp;
+    char path[64], comm[64], state;
+    int pid, parent;
+
+    *zombies = *running = 0;
+    if ((dir = opendir("/proc")) == NULL)
+	unix_error("opendir error");
+    while ((de = readdir(dir)) != NULL) {
+	if ((pid = atoi(de->d_name)) <= 0)
+	    continue;
+	snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+	if ((fp = fopen(path, "r")) == NULL)
+	    continue;
+
+	/* The command name is in parens and may hold spaces */
+	if (fscanf(fp, "%*d (%63[^)]) %c %d", comm, &state, &parent) == 3
+	    && parent == ppid && strcmp(comm, SRVNAME)) {
+	    if (state == 'Z')
+		(*zombies)++;
+	    else if (state != 'T' && state != 't')
+		(*running)++;
+	}
+	fclose(fp);
+    }
+    closedir(dir);
+}
+
+/* seen - Has the shell written marker to the output file yet? */
+static int seen(int fd, const char *marker)
+{
+    static char buf[1 << 20];
+    ssize_t n;
+
+    if ((n = pread(fd, buf, sizeof(buf) - 1, 0)) < 0)
+	unix_error("pread error");
+    buf[n] = '\0';
+    return strstr(buf, marker) != NULL;
+}
+
+int main(int argc, char **argv)
+{
+    int c, i, n = 1000, nstop = 0, nrun = 0, zombies, running, status;
+    int fd, in[2], hung = 0;
+    FILE *out, *to;
+    pid_t shell;
+    char line[MAXLINE], outname[] = "/tmp/reapstressXXXXXX";
+    time_t deadline;
+    struct timespec tick = { 0, 20000000 };
+
+    while ((c = getopt(argc, argv, "+n:")) != EOF) {
+	switch (c) {
+	case 'n':
+	    n = atoi(optarg);
+	    break;
+	default:
+	    optind = argc;
+	}
+    }
+    if (optind >= argc || n < 1) {
+	fprintf(stderr, "Usage: %s [-n <jobs>] <shell> [args...]\n", argv[0]);
+	exit(1);
+    }
+
+    /* The shell's output goes to a file so it never blocks on us */
+    if ((fd = mkstemp(outname)) < 0 || pipe(in) < 0)
+	unix_error("setup error");
+    if ((shell = fork()) < 0)
+	unix_error("fork error");
+    if (shell == 0) {
+	dup2(in[0], STDIN_FILENO);
+	close(in[0]);
+	close(in[1]);
+	if (freopen(outname, "a", stdout) == NULL)
+	    unix_error("freopen error");
+	execv(argv[optind], &argv[optind]);
+	unix_error("execv error");
+    }
+    close(in[0]);
+    if ((to = fdopen(in[1], "w")) == NULL)
+	unix_error("fdopen error");
+
+    for (i = 1; i <= n; i++) {
+	if (i % STOPEVERY == 0 || i == n - 2) {
+	    fprintf(to, "./mystop 0 &\n");
+	    nstop++;
+	} else {
+	    fprintf(to, "/bin/true &\n");
+	}
+    }
+    fprintf(to, "/bin/echo reapstress-launched\n");
+    fflush(to);
+
+    /* Once every job is launched, wait until each has either exited
+     * and been reaped or stopped */
+    deadline = time(NULL) + TIMEOUT;
+    while (!seen(fd, "reapstress-launched") && time(NULL) < deadline)
+	nanosleep(&tick, NULL);
+    do {
+	nanosleep(&tick, NULL);
+	scanchildren(shell, &zombies, &running);
+    } while ((zombies > 0 || running > 0) && time(NULL) < deadline);
+
+    /* A shell that lost a foreground child never gets to the jobs
+     * command, so give up on it after a while */
+    fprintf(to, "jobs\n");
+    fclose(to);
+    deadline = time(NULL) + TIMEOUT;
+    while (waitpid(shell, &status, WNOHANG) == 0) {
+	if (time(NULL) >= deadline) {
+	    kill(shell, SIGKILL);
+	    waitpid(shell, &status, 0);
+	    hung = 1;
+	}
+	nanosleep(&tick, NULL);
+    }
+
+    if ((out = fdopen(fd, "r")) == NULL)
+	unix_error("fdopen error");
+    while (fgets(line, sizeof(line), out) != NULL)
+	if (strstr(line, " Running ") != NULL)
+	    nrun++;
+    fclose(out);
+    unlink(outname);
+
+    printf("reapstress: %d jobs, %d stopped, %d zombies, %d still running,"
+	   " %d listed as running\n", n, nstop, zombies, running, nrun);
+    if (hung)
+	printf("reapstress: shell hung and was killed\n");
+    if (zombies > 0 || running > 0 || nrun > 0 || hung) {
+	printf("reapstress: FAILED\n");
+	exit(1);
+    }
+    printf("reapstress: OK\n");
+    exit(0);
+}
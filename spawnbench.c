@@ -0,0 +1,101 @@
+/*
+ * spawnbench.c - Measure how fast the shell can start jobs
+ *
+ * usage: spawnbench [-n <spawns>] [-m <MB>] [prog]
+ * Starts prog (default /bin/true) <spawns> times through launch(),
+ * with LAUNCH_FORK, LAUNCH_SPAWN and LAUNCH_SERVER in turn, reaping
+ * each child before starting the next. Before timing, <MB> megabytes
+ * of heap are allocated and touched to stand in for a shell that has
+ * grown, since that is what makes a full fork slow. The spawn server
+ * is started first, while the process is still small, as msh does.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "util.h"
+#include "launch.h"
+#include "spawnsrv.h"
+
+/* now - Monotonic clock in seconds */
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* bench - Time n launches of argv in the given mode */
+static double bench(char **argv, int mode, int n, const sigset_t *prev)
+{
+    int i, status;
+    pid_t pid;
+    struct proc_t proc = { argv[0], argv, 0, -1, -1, NULL, 0, -1 };
+    double start = now();
+
+    for (i = 0; i < n; i++) {
+	if ((pid = launch(&proc, mode, prev)) < 0)
+	    unix_error("launch error");
+	if (pid > 0 && waitpid(pid, &status, 0) < 0)
+	    unix_error("waitpid error");
+    }
+    return now() - start;
+}
+
+int main(int argc, char **argv)
+{
+    int c, n = 2000, mb = 0;
+    char *prog[] = { "/bin/true", NULL };
+    char *heap = NULL;
+    sigset_t mask, prev;
+    double tfork, tspawn, tserver;
+
+    while ((c = getopt(argc, argv, "n:m:")) != EOF) {
+	switch (c) {
+	case 'n':
+	    n = atoi(optarg);
+	    break;
+	case 'm':
+	    mb = atoi(optarg);
+	    break;
+	default:
+	    fprintf(stderr, "Usage: %s [-n <spawns>] [-m <MB>] [prog]\n",
+		    argv[0]);
+	    exit(1);
+	}
+    }
+    if (optind < argc)
+	prog[0] = argv[optind];
+    if (n < 1) {
+	fprintf(stderr, "spawns must be positive\n");
+	exit(1);
+    }
+
+    if (srvstart() < 0)
+	unix_error("srvstart error");
+    if (mb > 0) {
+	if ((heap = malloc((size_t) mb << 20)) == NULL)
+	    unix_error("malloc error");
+	memset(heap, 1, (size_t) mb << 20);
+    }
+
+    /* Block SIGCHLD around launches, as eval does */
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &mask, &prev);
+
+    tfork = bench(prog, LAUNCH_FORK, n, &prev);
+    tspawn = bench(prog, LAUNCH_SPAWN, n, &prev);
+    tserver = bench(prog, LAUNCH_SERVER, n, &prev);
+
+    printf("heap %5d MB  spawns/sec  fork %7.0f  spawn %7.0f  server %7.0f"
+	   "  (%.2fx, %.2fx)\n", mb, n / tfork, n / tspawn, n / tserver,
+	   tfork / tspawn, tfork / tserver);
+    free(heap);
+    exit(0);
+}
@@ -0,0 +1,351 @@
+#define _GNU_SOURCE         /* for MSG_CMSG_CLOEXEC */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/prctl.h>
+#include <sys/syscall.h>
+#include "util.h"
+#include "spawnsrv.h"
+
+/*
+ * The spawn server (msh -S) is a copy of the shell forked at startup,
+ * before the shell has grown, that does all later forking for it.
+ * However large the shell's heap and job table get, each launch only
+ * copies the server's few pages.
+ *
+ * The shell sends each proc_t as one request over a SOCK_SEQPACKET
+ * socket, passing its pipe ends, terminal and redirected files with
+ * SCM_RIGHTS. The server starts the process with clone(CLONE_PARENT),
+ * so it is the shell's child, not the server's: SIGCHLD, wait4, its
+ * rusage and setpgid from the shell work just as with fork, and the
+ * server has no exit statuses to pass on. The child joins its process
+ * group and takes the terminal itself, as launch_fork's does, and the
+ * shell does the same from its side once it has the pid.
+ *
+ * The server keeps the environment jobs get. It starts with the one
+ * the shell was started with; a request carries the shell's envp only
+ * when that has changed since the last one the server was sent.
+ */
+
+#define SRVMSG  (64 * 1024)         /* largest request */
+#define SRVFDS  (3 + MAXREDIRS)     /* most descriptors in a request */
+
+#define SRV_IN   1                  /* an infd is passed */
+#define SRV_OUT  2                  /* an outfd is passed */
+#define SRV_TTY  4                  /* a ttyfd is passed */
+#define SRV_ENV  8                  /* a new environment is passed */
+
+/*
+ * A request: this, then the program's path, its argv strings and with
+ * SRV_ENV the nenv strings of the environment, all NUL terminated.
+ * The descriptors come in the order infd, outfd, ttyfd (those flags
+ * says are there), then one for each redirection that has no dupfd.
+ */
+struct srvreq_t {
+    pid_t pgid;                     /* process group to join, or 0 */
+    sigset_t mask;                  /* signal mask to exec with */
+    int flags;                      /* SRV_IN | SRV_OUT | SRV_TTY | SRV_ENV */
+    int argc;
+    int nenv;                       /* strings in a new environment */
+    int nredirs;
+    struct {
+	int fd;                     /* descriptor being redirected */
+	int dupfd;                  /* copy of this, or -1 for a file */
+    } redirs[MAXREDIRS];
+};
+
+struct srvrep_t {
+    pid_t pid;                      /* the new process, or -1 */
+    int err;                        /* errno if there is none */
+};
+
+static int srvfd = -1;              /* the shell's end, -1 if no server */
+static unsigned long srvenvgen;     /* envgen of the server's environment */
+static char **srvenv;               /* in the server: the environment, if
+                                       one has been sent */
+
+
+/*
+ * srvchild - In the new process: set it up as launch_fork's child
+ *     is set up, with the passed descriptors fds, and exec
+ */
+static void srvchild(struct srvreq_t *req, int *fds, char *path,
+		     char **argv)
+{
+    int i, fd, k = 0, infd = -1, outfd = -1;
+
+    if (req->flags & SRV_IN)
+	infd = fds[k++];
+    if (req->flags & SRV_OUT)
+	outfd = fds[k++];
+    setpgid(0, req->pgid);
+    if (req->flags & SRV_TTY)
+	tcsetpgrp(fds[k++], getpgrp());
+    Signal(SIGTTIN, SIG_DFL);
+    Signal(SIGTTOU, SIG_DFL);
+    sigprocmask(SIG_SETMASK, &req->mask, NULL);
+
+    /* Everything passed is close-on-exec, so only these copies stay */
+    if (infd >= 0)
+	dup2(infd, STDIN_FILENO);
+    if (outfd >= 0)
+	dup2(outfd, STDOUT_FILENO);
+    for (i = 0; i < req->nredirs; i++) {
+	if (req->redirs[i].dupfd >= 0) {
+	    dup2(req->redirs[i].dupfd, req->redirs[i].fd);
+	    continue;
+	}
+	if ((fd = fds[k++]) != req->redirs[i].fd)
+	    dup2(fd, req->redirs[i].fd);
+	else
+	    fcntl(fd, F_SETFD, 0);
+    }
+
+    execve(path, argv, srvenv != NULL ? srvenv : environ);
+    printf("%s: Command not found\n", argv[0]);
+    fflush(stdout);
+    _exit(1);
+}
+
+/*
+ * srvsetenv - In the server: keep a copy of the n strings at p as the
+ *     environment from now on
+ */
+static void srvsetenv(char *p, int n)
+{
+    char *end, *s;
+    int i;
+
+    for (end = p, i = 0; i < n; i++)
+	end += strlen(end) + 1;
+    free(srvenv);
+    if ((srvenv = malloc((n + 1) * sizeof(char *) + (end - p))) == NULL)
+	_exit(1);
+    s = memcpy(srvenv + n + 1, p, end - p);
+    for (i = 0; i < n; i++) {
+	srvenv[i] = s;
+	s += strlen(s) + 1;
+    }
+    srvenv[n] = NULL;
+}
+
+/* srvloop - Serve requests on sock until the shell goes away */
+static void srvloop(int sock)
+{
+    static char buf[SRVMSG];
+    char cbuf[CMSG_SPACE(SRVFDS * sizeof(int))], *p, *path, **argv = NULL;
+    struct srvreq_t *req = (struct srvreq_t *) buf;
+    struct srvrep_t rep;
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr *cm;
+    int i, fds[SRVFDS], nfds;
+    ssize_t n;
+
+    while (1) {
+	memset(&msg, 0, sizeof(msg));
+	iov.iov_base = buf;
+	iov.iov_len = sizeof(buf);
+	msg.msg_iov = &iov;
+	msg.msg_iovlen = 1;
+	msg.msg_control = cbuf;
+	msg.msg_controllen = sizeof(cbuf);
+	if ((n = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC)) < 0 && errno == EINTR)
+	    continue;
+	if (n < (ssize_t) sizeof(*req))
+	    _exit(0);
+
+	nfds = 0;
+	for (cm = CMSG_FIRSTHDR(&msg); cm != NULL; cm = CMSG_NXTHDR(&msg, cm))
+	    if (cm->cmsg_level == SOL_SOCKET && cm->cmsg_type == SCM_RIGHTS) {
+		nfds = (cm->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+		memcpy(fds, CMSG_DATA(cm), nfds * sizeof(int));
+	    }
+
+	if ((argv = realloc(argv, (req->argc + 1) * sizeof(char *))) == NULL)
+	    _exit(1);
+	path = p = (char *) (req + 1);
+	for (i = 0; i < req->argc; i++)
+	    argv[i] = p += strlen(p) + 1;
+	argv[i] = NULL;
+	if (req->flags & SRV_ENV)
+	    srvsetenv(p + strlen(p) + 1, req->nenv);
+
+	rep.pid = syscall(SYS_clone, CLONE_PARENT | SIGCHLD, NULL, NULL,
+			  NULL, NULL);
+	if (rep.pid == 0)
+	    srvchild(req, fds, path, argv);
+	rep.err = errno;
+	while (nfds > 0)
+	    close(fds[--nfds]);
+	send(sock, &rep, sizeof(rep), MSG_NOSIGNAL);
+    }
+}
+
+/*
+ * srvstart - Fork the spawn server. Call it early, while the shell is
+ *     still small and has not installed its handlers. Returns 0, or -1
+ *     if there is no server.
+ */
+int srvstart(void)
+{
+    int sv[2];
+    pid_t pid, shell = getpid();
+
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) < 0)
+	return -1;
+    if ((pid = fork()) < 0) {
+	close(sv[0]);
+	close(sv[1]);
+	return -1;
+    }
+    if (pid == 0) {
+	/* Its own group keeps it out of the way of terminal signals.
+	 * Its children get the dispositions a forked job would. */
+	close(sv[0]);
+	setpgid(0, 0);
+	prctl(PR_SET_PDEATHSIG, SIGKILL);
+	prctl(PR_SET_NAME, SRVNAME);
+	if (getppid() != shell)
+	    _exit(0);
+	Signal(SIGINT, SIG_DFL);
+	Signal(SIGTSTP, SIG_DFL);
+	Signal(SIGQUIT, SIG_DFL);
+	Signal(SIGCHLD, SIG_DFL);
+	Signal(SIGTTIN, SIG_IGN);
+	Signal(SIGTTOU, SIG_IGN);
+	srvloop(sv[1]);
+    }
+    close(sv[1]);
+    srvfd = sv[0];
+    return 0;
+}
+
+/* srvlost - Give up on the server; launch falls back to fork */
+static pid_t srvlost(void)
+{
+    close(srvfd);
+    srvfd = -1;
+    errno = ENOTCONN;
+    return -1;
+}
+
+/*
+ * srvlaunch - Have the server start proc, with launch's contract.
+ *     Redirected files are opened here, as in launch_spawn, so open
+ *     errors are reported by the shell. Returns -1 with errno set to
+ *     ENOTCONN if the server cannot take proc (it is gone, or the
+ *     request would not fit); the caller then starts it another way.
+ */
+pid_t srvlaunch(struct proc_t *proc, const sigset_t *mask)
+{
+    static char buf[SRVMSG];
+    char cbuf[CMSG_SPACE(SRVFDS * sizeof(int))], *p;
+    struct srvreq_t *req = (struct srvreq_t *) buf;
+    struct srvrep_t rep;
+    struct msghdr msg;
+    struct iovec iov;
+    struct cmsghdr *cm;
+    int i, fds[SRVFDS], nfds = 0, nstd, sendenv;
+    size_t len;
+    ssize_t n;
+
+    if (srvfd < 0) {
+	errno = ENOTCONN;
+	return -1;
+    }
+
+    memset(req, 0, sizeof(*req));
+    req->pgid = proc->pgid;
+    req->mask = *mask;
+    len = sizeof(*req) + strlen(proc->path) + 1;
+    for (req->argc = 0; proc->argv[req->argc] != NULL; req->argc++)
+	len += strlen(proc->argv[req->argc]) + 1;
+    sendenv = proc->envp != NULL && proc->envgen != srvenvgen;
+    if (sendenv) {
+	req->flags |= SRV_ENV;
+	for (req->nenv = 0; proc->envp[req->nenv] != NULL; req->nenv++)
+	    len += strlen(proc->envp[req->nenv]) + 1;
+    }
+    if (len > sizeof(buf)) {
+	errno = ENOTCONN;
+	return -1;
+    }
+    p = stpcpy((char *) (req + 1), proc->path) + 1;
+    for (i = 0; i < req->argc; i++)
+	p = stpcpy(p, proc->argv[i]) + 1;
+    for (i = 0; i < req->nenv; i++)
+	p = stpcpy(p, proc->envp[i]) + 1;
+
+    if (proc->infd >= 0) {
+	req->flags |= SRV_IN;
+	fds[nfds++] = proc->infd;
+    }
+    if (proc->outfd >= 0) {
+	req->flags |= SRV_OUT;
+	fds[nfds++] = proc->outfd;
+    }
+    if (proc->ttyfd >= 0) {
+	req->flags |= SRV_TTY;
+	fds[nfds++] = proc->ttyfd;
+    }
+    nstd = nfds;
+    req->nredirs = proc->nredirs;
+    for (i = 0; i < proc->nredirs; i++) {
+	req->redirs[i].fd = proc->redirs[i].fd;
+	req->redirs[i].dupfd = proc->redirs[i].dupfd;
+	if (proc->redirs[i].path == NULL)
+	    continue;
+	req->redirs[i].dupfd = -1;
+	if ((fds[nfds] = openredir(&proc->redirs[i])) < 0) {
+	    while (nfds > nstd)
+		close(fds[--nfds]);
+	    return 0;
+	}
+	nfds++;
+    }
+
+    memset(&msg, 0, sizeof(msg));
+    iov.iov_base = buf;
+    iov.iov_len = len;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if (nfds > 0) {
+	msg.msg_control = cbuf;
+	msg.msg_controllen = CMSG_SPACE(nfds * sizeof(int));
+	cm = CMSG_FIRSTHDR(&msg);
+	cm->cmsg_level = SOL_SOCKET;
+	cm->cmsg_type = SCM_RIGHTS;
+	cm->cmsg_len = CMSG_LEN(nfds * sizeof(int));
+	memcpy(CMSG_DATA(cm), fds, nfds * sizeof(int));
+    }
+    while ((n = sendmsg(srvfd, &msg, MSG_NOSIGNAL)) < 0 && errno == EINTR)
+	;
+    while (nfds > nstd)
+	close(fds[--nfds]);
+    if (n < 0)
+	return srvlost();
+    while ((n = recv(srvfd, &rep, sizeof(rep), 0)) < 0 && errno == EINTR)
+	;
+    if (n != sizeof(rep))
+	return srvlost();
+    if (sendenv)
+	srvenvgen = proc->envgen;
+    if (rep.pid < 0) {
+	errno = rep.err;
+	return -1;
+    }
+
+    /* From this side too, as launch_fork does */
+    setpgid(rep.pid, proc->pgid ? proc->pgid : rep.pid);
+    if (proc->ttyfd >= 0)
+	tcsetpgrp(proc->ttyfd, proc->pgid ? proc->pgid : rep.pid);
+    return rep.pid;
+}
@@ -0,0 +1,13 @@
+#ifndef _SPAWNSRV_H_
+#define _SPAWNSRV_H_
+
+#include <signal.h>
+#include <sys/types.h>
+#include "launch.h"
+
+#define SRVNAME "msh-spawn"     /* the server's command name, for ps */
+
+int srvstart(void);
+pid_t srvlaunch(struct proc_t *proc, const sigset_t *mask);
+
+#endif
@@ -0,0 +1,68 @@
+#include <stdio.h>
+#include <string.h>
+#include "stats.h"
+
+/*
+ * Counters and histograms of the shell's own work, updated inline by
+ * eval, waitfg and sigchld_handler and printed by the stats builtin
+ * (or to $MSHSTATS when the shell exits). Updates are plain adds on
+ * a static struct, cheap enough to leave on all the time.
+ */
+struct stats_t stats;
+
+
+/* histadd - Add v to histogram h. Safe to call from a signal handler. */
+void histadd(struct hist_t *h, long v)
+{
+    int k = v > 0 ? 64 - __builtin_clzl((unsigned long) v) : 0;
+
+    if (k >= HISTBUCKETS)
+	k = HISTBUCKETS - 1;
+    h->bucket[k]++;
+    h->n++;
+    h->sum += v;
+    if (v > h->max)
+	h->max = v;
+}
+
+/* printhist - Print h's summary line and its non-empty buckets */
+static void printhist(FILE *fp, const char *name, const struct hist_t *h,
+		      const char *unit)
+{
+    char range[64];
+    int k;
+
+    fprintf(fp, "%-12s n %ld  mean %.1f%s  max %ld%s\n", name, h->n,
+	    h->n ? (double) h->sum / h->n : 0.0, unit, h->max, unit);
+    for (k = 0; k < HISTBUCKETS; k++)
+	if (h->bucket[k] > 0) {
+	    snprintf(range, sizeof(range), "%ld-%ld%s", k ? 1L << (k - 1) : 0,
+		     k ? (1L << k) - 1 : 0, unit);
+	    fprintf(fp, "  %-22s %ld\n", range, h->bucket[k]);
+	}
+}
+
+/*
+ * printstats - Print every counter and histogram to fp, along with
+ *     the njobs live jobs and nslots slots the job table has now
+ */
+void printstats(FILE *fp, int njobs, int nslots)
+{
+    fprintf(fp, "launches     %ld started  %ld failed  %ld in shell  "
+	    "%ld envs built\n", stats.launches, stats.launchfail,
+	    stats.inshell, stats.envbuilds);
+    printhist(fp, "launch time", &stats.launchus, "us");
+    fprintf(fp, "SIGCHLD      %ld runs  %ld reaped  %ld stopped\n",
+	    stats.sigchld, stats.reaped, stats.stopped);
+    printhist(fp, "reaped/run", &stats.perchld, "");
+    fprintf(fp, "waitfg       %ld wakeups  %ld useful\n", stats.wakeups,
+	    stats.useful);
+    fprintf(fp, "jobs         %d live  %d max  %d slots\n", njobs,
+	    stats.jobsmax, nslots);
+}
+
+/* clearstats - Start counting from zero. SIGCHLD must be blocked. */
+void clearstats(void)
+{
+    memset(&stats, 0, sizeof(stats));
+}
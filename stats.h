@@ -0,0 +1,47 @@
+#ifndef _STATS_H_
+#define _STATS_H_
+
+#include <stdio.h>
+
+#define HISTBUCKETS 32      /* log2 buckets, enough for any 32-bit value */
+
+/*
+ * A histogram of non-negative values. Bucket 0 counts zeros and
+ * bucket k > 0 counts values in [2^(k-1), 2^k), so adding a value is
+ * a count-leading-zeros and three increments.
+ */
+struct hist_t {
+    long n;                 /* values added */
+    long sum;               /* their total */
+    long max;               /* the largest */
+    long bucket[HISTBUCKETS];
+};
+
+/*
+ * What the shell has been doing. Each field is only written from one
+ * place: the launch, environment and wait fields in the shell's main
+ * flow, the SIGCHLD fields in sigchld_handler. clearstats writes them
+ * all, so it must be called with SIGCHLD blocked.
+ */
+struct stats_t {
+    long launches;          /* processes started */
+    long launchfail;        /* launches that could not start a program */
+    long inshell;           /* commands msh -b ran without a process */
+    long envbuilds;         /* environments built for jobs */
+    struct hist_t launchus; /* time spent in launch, microseconds */
+    long sigchld;           /* sigchld_handler runs */
+    long reaped;            /* children it reaped */
+    long stopped;           /* children it saw stop */
+    struct hist_t perchld;  /* children reaped per run */
+    long wakeups;           /* times waitfg woke */
+    long useful;            /* wakeups that found the FG job done */
+    int jobsmax;            /* most jobs on the list at once */
+};
+
+extern struct stats_t stats;
+
+void histadd(struct hist_t *h, long v);
+void printstats(FILE *fp, int njobs, int nslots);
+void clearstats(void);
+
+#endif
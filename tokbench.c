@@ -0,0 +1,122 @@
+/*
+ * tokbench.c - Compare tokenize against parseline
+ *
+ * usage: tokbench [-n <lines>] [-r <rounds>]
+ * Generates a script of <lines> command lines in memory, mixing plain
+ * words, single-quoted words, pipelines, redirections and background
+ * jobs (only what both tokenizers understand), then splits every line
+ * <rounds> times with parseline and with tokenize and reports the
+ * tokens per second of each.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include "util.h"
+
+/* Pieces the generated lines are built from */
+static const char *words[] = {
+    "/bin/echo", "./myspin", "ls", "-l", "/usr/bin/tr", "a-z", "A-Z",
+    "'hello world'", "'a | b'", "file.txt", "--verbose", "12345",
+};
+static const char *ops[] = { "|", "<", ">", ">>", "2>&1" };
+
+/* now - Monotonic clock in seconds */
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * genline - Write one random command line, newline terminated, to
+ *     buf and return its length.
+ */
+static int genline(char *buf)
+{
+    int i, n = 3 + rand() % 20, len = 0;
+    const char *w;
+
+    for (i = 0; i < n; i++) {
+	if (i > 0 && i < n - 1 && rand() % 6 == 0)
+	    w = ops[rand() % (sizeof(ops) / sizeof(ops[0]))];
+	else
+	    w = words[rand() % (sizeof(words) / sizeof(words[0]))];
+	len += sprintf(buf + len, "%s%s", i ? " " : "", w);
+    }
+    if (rand() % 4 == 0)
+	len += sprintf(buf + len, " &");
+    buf[len++] = '\n';
+    buf[len] = '\0';
+    return len;
+}
+
+int main(int argc, char **argv)
+{
+    int c, i, r, n = 100000, rounds = 10, *lens;
+    char **lines, *script, *end, *args[MAXARGS];
+    long ntok = 0, check = 0;
+    struct arena_t arena = { NULL, NULL, 0, 0 };
+    double start, tparse, ttok;
+
+    while ((c = getopt(argc, argv, "n:r:")) != EOF) {
+	switch (c) {
+	case 'n':
+	    n = atoi(optarg);
+	    break;
+	case 'r':
+	    rounds = atoi(optarg);
+	    break;
+	default:
+	    fprintf(stderr, "Usage: %s [-n <lines>] [-r <rounds>]\n", argv[0]);
+	    exit(1);
+	}
+    }
+    if (n < 1 || rounds < 1) {
+	fprintf(stderr, "lines and rounds must be positive\n");
+	exit(1);
+    }
+
+    /* The longest generated line is well under MAXLINE */
+    script = malloc((size_t) n * MAXLINE / 2);
+    lines = malloc(n * sizeof(char *));
+    lens = malloc(n * sizeof(int));
+    if (script == NULL || lines == NULL || lens == NULL)
+	unix_error("malloc error");
+    srand(1);
+    for (i = 0, end = script; i < n; i++) {
+	lines[i] = end;
+	lens[i] = genline(end);
+	end += lens[i] + 1;
+    }
+    if (arenafit(&arena, MAXLINE) < 0)
+	unix_error("arenafit error");
+
+    start = now();
+    for (r = 0; r < rounds; r++)
+	for (i = 0; i < n; i++) {
+	    parseline(lines[i], args);
+	    for (c = 0; args[c] != NULL; c++)
+		;
+	    ntok += c;
+	}
+    tparse = now() - start;
+
+    start = now();
+    for (r = 0; r < rounds; r++)
+	for (i = 0; i < n; i++) {
+	    tokenize(lines[i], lens[i], &arena);
+	    check += arena.argc;
+	}
+    ttok = now() - start;
+
+    if (check != ntok)
+	printf("tokbench: token counts differ (%ld vs %ld)\n", ntok, check);
+    printf("%d lines x %d  parseline %9.0f tokens/sec  tokenize %9.0f"
+	   " tokens/sec  (%.2fx)\n", n, rounds, ntok / tparse, check / ttok,
+	   tparse / ttok);
+    exit(0);
+}
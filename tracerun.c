@@ -0,0 +1,476 @@
+/*
+ * tracerun.c - Run every trace at once and check msh against mshref
+ *
+ * usage: tracerun [-v] [-j <jobs>] [-s <shell>] [-a <args>] [-r <ref>]
+ *                 [-A <refargs>] [trace...]
+ * Runs each trace (default: every trace*.txt here) through <shell>
+ * (default ./msh) with <args> and through <ref> (default ./mshref)
+ * with <refargs>, both -p by default. Every run is a driver process
+ * of its own, leading a session on a pseudo-terminal of its own, and
+ * up to <jobs> of them (default: all) run at once, so the whole suite
+ * takes about as long as its slowest trace rather than the sum of
+ * their SLEEPs.
+ *
+ * A driver plays the trace the way sdriver.pl does and produces the
+ * same output: comment lines first, then everything the shell wrote.
+ * It also reads the shell's output while the trace is being played,
+ * so it can time each command from when it is written to the next
+ * output from the shell. Runs of the same trace are compared with
+ * every "(pid)" replaced by "(PID)", and with what "/bin/ps a" lists
+ * cut down to the state and command of each process on the run's own
+ * terminal, other than the driver and the shell. A trace that uses
+ * something the reference shell lacks is compared with traceNN.expect
+ * instead, if that file exists.
+ *
+ * For each trace it prints whether the outputs matched, the wall time
+ * of the shell's run, and the median and worst command latency. With
+ * -v the outputs of a mismatch are printed too. Exits nonzero if any
+ * trace failed.
+ */
+#define _GNU_SOURCE         /* for posix_openpt */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <glob.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include "util.h"
+
+#define MAXLAT  256     /* command latencies kept per run */
+#define TIMEOUT 60      /* seconds before a run is killed */
+
+struct result_t {       /* What a driver reports, in shared memory */
+    double wall;        /* seconds from start to the shell's exit */
+    int nlat;           /* latencies measured */
+    double lat[MAXLAT]; /* seconds from each command to next output */
+    int done;           /* the driver finished the trace */
+};
+
+struct run_t {          /* One driver process */
+    const char *trace;  /* the trace it plays */
+    const char *shell;  /* the shell it drives */
+    const char *args;   /* and its arguments */
+    pid_t pid;          /* the driver, which leads its session */
+    FILE *out;          /* where it writes the output */
+    struct result_t *res;
+    double start;       /* when the runner started it */
+};
+
+
+/* now - Monotonic clock in seconds */
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * drain - Read what the shell has written within timeout seconds (or
+ *     until end of file if timeout is negative) into out, resolving
+ *     the latency of every command still waiting for output.
+ *     Returns 0 at end of file, 1 otherwise.
+ */
+static int drain(int fd, FILE *out, double timeout, struct result_t *res,
+		 double *pending, int *npending)
+{
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    char buf[4096];
+    double end = now() + timeout, t;
+    int n, ms;
+
+    while (1) {
+	ms = timeout < 0 ? -1 : (int) ((end - now()) * 1000);
+	if (timeout >= 0 && ms < 0)
+	    ms = 0;
+	if ((n = poll(&pfd, 1, ms)) < 0 && errno != EINTR)
+	    unix_error("poll error");
+	if (n == 0)
+	    return 1;
+	if (n < 0)
+	    continue;
+	if ((n = read(fd, buf, sizeof(buf))) <= 0)
+	    return 0;
+	fwrite(buf, 1, n, out);
+	t = now();
+	while (*npending > 0) {
+	    if (res->nlat < MAXLAT)
+		res->lat[res->nlat++] = t - pending[--*npending];
+	    else
+		--*npending;
+	}
+	if (timeout >= 0 && now() >= end)
+	    return 1;
+    }
+}
+
+/*
+ * opentty - Make a new pseudo-terminal the controlling terminal of the
+ *     driver, which leads a session of its own, and so of the shell
+ *     and its jobs. Returns its name as ps shows it, e.g. "pts/3".
+ */
+static const char *opentty(void)
+{
+    char *name = NULL;
+    int master, slave = -1;
+
+    if ((master = posix_openpt(O_RDWR | O_NOCTTY | O_CLOEXEC)) >= 0
+	&& grantpt(master) == 0 && unlockpt(master) == 0
+	&& (name = ptsname(master)) != NULL)
+	slave = open(name, O_RDWR);
+    if (slave < 0)
+	unix_error("pty error");
+    close(slave);
+    return name + strlen("/dev/");
+}
+
+/*
+ * copyout - Copy the shell's output from in to out, keeping only the
+ *     state and command of the processes "/bin/ps a" lists on tty,
+ *     other than the driver and those running shell, the shell's own
+ *     command line (any helper it forks included): ps lists every
+ *     terminal on the machine, and pids and times change between runs.
+ */
+static void copyout(FILE *in, FILE *out, const char *tty, const char *shell)
+{
+    char line[MAXLINE], name[64], stat[16], time[16], *cmd;
+    int pid, off;
+
+    while (fgets(line, sizeof(line), in) != NULL) {
+	off = -1;
+	sscanf(line, " PID TTY STAT TIME COMMAND%n", &off);
+	if (off >= 0) {
+	    fputs("STAT   COMMAND\n", out);
+	} else if (sscanf(line, "%d %63s %15s %15[0-9:] %n", &pid, name, stat,
+			  time, &off) == 4) {
+	    cmd = line + off;
+	    cmd[strcspn(cmd, "\n")] = '\0';
+	    if (!strcmp(name, tty) && pid != getpid() && strcmp(cmd, shell))
+		fprintf(out, "%-6s %s\n", stat, cmd);
+	} else {
+	    fputs(line, out);
+	}
+    }
+}
+
+/*
+ * drive - Play trace against shell like sdriver.pl, writing the
+ *     comment lines and then the shell's output to out. Runs in a
+ *     process of its own, which leads its session.
+ */
+static void drive(const char *trace, const char *shell, const char *args,
+		  FILE *out, struct result_t *res)
+{
+    FILE *in, *shout;
+    char line[MAXLINE], cmd[MAXLINE * 2], *p;
+    const char *tty;
+    double start = now(), pending[MAXLAT];
+    int tosh[2], fromsh[2], npending = 0, writing = 1, eof = 0, n;
+    pid_t pid;
+
+    tty = opentty();
+    if ((in = fopen(trace, "r")) == NULL)
+	unix_error("fopen error");
+    if ((shout = tmpfile()) == NULL)
+	unix_error("tmpfile error");
+    if (pipe(tosh) < 0 || pipe(fromsh) < 0)
+	unix_error("pipe error");
+    signal(SIGPIPE, SIG_IGN);
+
+    /* Like open2, the shell's stderr is left alone */
+    if ((pid = fork()) < 0)
+	unix_error("fork error");
+    if (pid == 0) {
+	dup2(tosh[0], STDIN_FILENO);
+	dup2(fromsh[1], STDOUT_FILENO);
+	close(tosh[0]);
+	close(tosh[1]);
+	close(fromsh[0]);
+	close(fromsh[1]);
+	signal(SIGPIPE, SIG_DFL);
+	snprintf(cmd, sizeof(cmd), "exec %s %s", shell, args);
+	execl("/bin/sh", "sh", "-c", cmd, (char *) NULL);
+	_exit(127);
+    }
+    close(tosh[0]);
+    close(fromsh[1]);
+
+    /* The same commands, matched the same loose way, as sdriver.pl */
+    while (fgets(line, sizeof(line), in) != NULL) {
+	line[strcspn(line, "\n")] = '\0';
+	if (line[0] == '#') {
+	    fprintf(out, "%s\n", line);
+	} else if (line[strspn(line, " \t\r\f\v")] == '\0') {
+	    continue;
+	} else if (strstr(line, "TSTP") != NULL) {
+	    kill(pid, SIGTSTP);
+	} else if (strstr(line, "INT") != NULL) {
+	    kill(pid, SIGINT);
+	} else if (strstr(line, "QUIT") != NULL) {
+	    kill(pid, SIGQUIT);
+	} else if (strstr(line, "KILL") != NULL) {
+	    kill(pid, SIGKILL);
+	} else if (strstr(line, "CLOSE") != NULL) {
+	    if (writing)
+		close(tosh[1]);
+	    writing = 0;
+	} else if (strstr(line, "WAIT") != NULL) {
+	    /* Keep reading so the shell never blocks on a full pipe */
+	    while (!eof && waitpid(pid, NULL, WNOHANG) == 0)
+		eof = !drain(fromsh[0], shout, 0.01, res, pending, &npending);
+	    waitpid(pid, NULL, 0);
+	} else if ((p = strstr(line, "SLEEP ")) != NULL
+		   && sscanf(p + 6, "%d", &n) == 1) {
+	    if (!eof)
+		eof = !drain(fromsh[0], shout, n, res, pending, &npending);
+	    else
+		sleep(n);
+	} else if (writing) {
+	    n = snprintf(cmd, sizeof(cmd), "%s\n", line);
+	    if (write(tosh[1], cmd, n) == n && npending < MAXLAT)
+		pending[npending++] = now();
+	    if (!eof)
+		eof = !drain(fromsh[0], shout, 0, res, pending, &npending);
+	}
+    }
+    fclose(in);
+
+    if (writing)
+	close(tosh[1]);
+    if (!eof)
+	drain(fromsh[0], shout, -1, res, pending, &npending);
+    close(fromsh[0]);
+    waitpid(pid, NULL, 0);
+    res->wall = now() - start;
+
+    /* The shell's output goes after the comments */
+    rewind(shout);
+    snprintf(cmd, sizeof(cmd), "%s %s", shell, args);
+    copyout(shout, out, tty, cmd);
+    fflush(out);
+    res->done = 1;
+}
+
+/*
+ * startrun - Start a driver for run in a new session, which gets a
+ *     terminal of its own whether or not tracerun has one
+ */
+static void startrun(struct run_t *run)
+{
+    if ((run->out = tmpfile()) == NULL)
+	unix_error("tmpfile error");
+    run->res = mmap(NULL, sizeof(struct result_t), PROT_READ | PROT_WRITE,
+		    MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (run->res == MAP_FAILED)
+	unix_error("mmap error");
+    memset(run->res, 0, sizeof(struct result_t));
+    run->start = now();
+
+    fflush(stdout);
+    if ((run->pid = fork()) < 0)
+	unix_error("fork error");
+    if (run->pid == 0) {
+	setsid();
+	drive(run->trace, run->shell, run->args, run->out, run->res);
+	_exit(0);
+    }
+}
+
+/*
+ * slurp - Read out into a malloc'd string, with every "(digits)"
+ *     replaced by "(PID)"
+ */
+static char *slurp(FILE *out)
+{
+    char *s, *d, *p, *q;
+    long len;
+
+    fseek(out, 0, SEEK_END);
+    len = ftell(out);
+    rewind(out);
+    s = malloc(len + 1);
+    d = malloc(2 * len + 1);   /* "(1)" grows to "(PID)" */
+    if (s == NULL || d == NULL)
+	unix_error("malloc error");
+    len = fread(s, 1, len, out);
+    s[len] = '\0';
+
+    for (p = s, q = d; *p; ) {
+	if (*p == '(' && p[1] >= '0' && p[1] <= '9') {
+	    char *e = p + 1;
+
+	    while (*e >= '0' && *e <= '9')
+		e++;
+	    if (*e == ')') {
+		memcpy(q, "(PID)", 5);
+		q += 5;
+		p = e + 1;
+		continue;
+	    }
+	}
+	*q++ = *p++;
+    }
+    *q = '\0';
+    free(s);
+    return d;
+}
+
+/* readfile - Read the file at path into a malloc'd string, or NULL */
+static char *readfile(const char *path)
+{
+    FILE *fp;
+    char *s;
+
+    if ((fp = fopen(path, "r")) == NULL)
+	return NULL;
+    s = slurp(fp);
+    fclose(fp);
+    return s;
+}
+
+/* cmpdouble - qsort comparison for latencies */
+static int cmpdouble(const void *a, const void *b)
+{
+    double x = *(const double *) a, y = *(const double *) b;
+
+    return x < y ? -1 : x > y;
+}
+
+/* reap - Wait for any driver to finish, killing overdue ones */
+static struct run_t *reap(struct run_t *runs, int nruns)
+{
+    int i, status;
+    pid_t pid;
+    struct timespec tick = { 0, 10000000 };
+
+    while (1) {
+	if ((pid = waitpid(-1, &status, WNOHANG)) < 0)
+	    unix_error("waitpid error");
+	for (i = 0; pid > 0 && i < nruns; i++)
+	    if (runs[i].pid == pid) {
+		runs[i].pid = 0;
+		return &runs[i];
+	    }
+	for (i = 0; i < nruns; i++)
+	    if (runs[i].pid > 0 && now() - runs[i].start > TIMEOUT)
+		kill(-runs[i].pid, SIGKILL);
+	if (pid == 0)
+	    nanosleep(&tick, NULL);
+    }
+}
+
+/* report - Compare the two runs of a trace and print how it went */
+static int report(struct run_t *mine, struct run_t *ref, int verbose)
+{
+    char name[256], *got, *want, *e;
+    struct result_t *res = mine->res;
+    double med = 0, max = 0;
+    int ok;
+
+    snprintf(name, sizeof(name), "%s", mine->trace);
+    if ((e = strstr(name, ".txt")) != NULL)
+	strcpy(e, ".expect");
+    got = slurp(mine->out);
+    if ((want = readfile(name)) == NULL)
+	want = slurp(ref->out);
+    ok = res->done && ref->res->done && strcmp(got, want) == 0;
+
+    if (res->nlat > 0) {
+	qsort(res->lat, res->nlat, sizeof(double), cmpdouble);
+	med = res->lat[res->nlat / 2];
+	max = res->lat[res->nlat - 1];
+    }
+    printf("%-12s %-4s %7.2fs  latency med %7.2fms max %8.2fms\n",
+	   mine->trace, ok ? "ok" : "FAIL", res->wall, med * 1e3, max * 1e3);
+    if (!ok && verbose)
+	printf("--- %s\n%s--- expected\n%s---\n", mine->shell, got, want);
+    free(got);
+    free(want);
+    return ok;
+}
+
+int main(int argc, char **argv)
+{
+    char *shell = "./msh", *ref = "./mshref", *args = "-p", *refargs = "-p";
+    int c, i, j, n, jobs = 0, running = 0, verbose = 0, failed = 0;
+    struct run_t *runs, *done;
+    glob_t g;
+    char **traces;
+    double start = now();
+
+    while ((c = getopt(argc, argv, "vj:s:a:r:A:")) != EOF) {
+	switch (c) {
+	case 'v':
+	    verbose = 1;
+	    break;
+	case 'j':
+	    jobs = atoi(optarg);
+	    break;
+	case 's':
+	    shell = optarg;
+	    break;
+	case 'r':
+	    ref = optarg;
+	    break;
+	case 'a':
+	    args = optarg;
+	    break;
+	case 'A':
+	    refargs = optarg;
+	    break;
+	default:
+	    fprintf(stderr, "Usage: %s [-v] [-j <jobs>] [-s <shell>] [-a <args>]"
+		    " [-r <ref>] [-A <refargs>] [trace...]\n", argv[0]);
+	    exit(1);
+	}
+    }
+    if (optind < argc) {
+	traces = &argv[optind];
+	n = argc - optind;
+    } else {
+	if (glob("trace*.txt", 0, NULL, &g) != 0) {
+	    fprintf(stderr, "%s: no traces found\n", argv[0]);
+	    exit(1);
+	}
+	traces = g.gl_pathv;
+	n = g.gl_pathc;
+    }
+
+    /* runs[2i] plays trace i against shell, runs[2i+1] against ref */
+    if ((runs = calloc(2 * n, sizeof(*runs))) == NULL)
+	unix_error("calloc error");
+    for (i = 0; i < n; i++) {
+	runs[2 * i].trace = runs[2 * i + 1].trace = traces[i];
+	runs[2 * i].shell = shell;
+	runs[2 * i].args = args;
+	runs[2 * i + 1].shell = ref;
+	runs[2 * i + 1].args = refargs;
+    }
+    if (jobs < 1 || jobs > 2 * n)
+	jobs = 2 * n;
+
+    /* Keep jobs drivers going; report a trace once both runs are in */
+    for (i = 0, j = 0; j < 2 * n; j++) {
+	while (i < 2 * n && running < jobs) {
+	    startrun(&runs[i++]);
+	    running++;
+	}
+	done = reap(runs, i);
+	running--;
+	done->pid = -1;
+	c = (done - runs) & ~1;
+	if (runs[c].pid == -1 && runs[c + 1].pid == -1)
+	    failed += !report(&runs[c], &runs[c + 1], verbose);
+    }
+
+    printf("%d traces, %d failed, %.2fs\n", n, failed, now() - start);
+    exit(failed != 0);
+}
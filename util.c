@@ -12,18 +12,56 @@
 // make clean && make && ./psh
 // 
 
+/* Stand for unquoted operators in the argv built by parseline */
+char pipetok[] = "|";
+char intok[] = "<";
+char outtok[] = ">";
+char appendtok[] = ">>";
+char errtok[] = "2>";
+char errappendtok[] = "2>>";
+char errouttok[] = "2>&1";
+char bgtok[] = "&";
+char semitok[] = ";";
+char andtok[] = "&&";
+char ortok[] = "||";
+char nltok[] = "\n";
+
+/* The redirection operators, longest first so ">>" beats ">" */
+static char *redirtoks[] = {
+    errouttok, errappendtok, errtok, appendtok, outtok, intok, NULL
+};
+
+/* 
+ * redirtok - If a redirection operator starts at buf, return its
+ *     token, or NULL if there is none.
+ */
+static char *redirtok(const char *buf)
+{
+    char **tok;
+
+    for (tok = redirtoks; *tok != NULL; tok++)
+	if (strncmp(buf, *tok, strlen(*tok)) == 0)
+	    return *tok;
+    return NULL;
+}
+
 /* 
  * parseline - Parse the command line and build the argv array.
  * 
  * Characters enclosed in single quotes are treated as a single
- * argument.  Return true if the user has requested a BG job, false if
- * the user has requested a FG job.  
+ * argument. An unquoted '|' separates the commands of a pipeline and
+ * is returned as pipetok itself, so callers can tell it from a quoted
+ * "|" by comparing pointers. The redirection operators <, >, >>, 2>,
+ * 2>> and 2>&1 are returned the same way, but only at the start of a
+ * word, so "msh>" is still one word. Return true if the user has
+ * requested a BG job, false if the user has requested a FG job.  
  */
 int parseline(const char *cmdline, char **argv) 
 {
     static char array[MAXLINE]; /* holds local copy of command line */
     char *buf = array;          /* ptr that traverses command line */
-    char *delim;                /* points to first space delimiter */
+    char *delim;                /* points to first delimiter */
+    char *tok;                  /* redirection operator */
     int argc;                   /* number of args */
     int bg;                     /* background job? */
 
@@ -34,28 +72,31 @@ int parseline(const char *cmdline, char **argv)
 
     /* Build the argv list */
     argc = 0;
-    if (*buf == '\'') {
-	buf++;
-	delim = strchr(buf, '\'');
-    }
-    else {
-	delim = strchr(buf, ' ');
-    }
-
-    while (delim) {
-	argv[argc++] = buf;
-	*delim = '\0';
-	buf = delim + 1;
-	while (*buf && (*buf == ' ')) /* ignore spaces */
-	       buf++;
-
-	if (*buf == '\'') {
+    while (*buf) {
+	if (*buf == '|') {
+	    argv[argc++] = pipetok;
 	    buf++;
-	    delim = strchr(buf, '\'');
-	}
-	else {
-	    delim = strchr(buf, ' ');
+	} else if ((tok = redirtok(buf)) != NULL) {
+	    argv[argc++] = tok;
+	    buf += strlen(tok);
+	} else if (*buf == '\'') {
+	    buf++;
+	    if ((delim = strchr(buf, '\'')) == NULL)
+		break;
+	    argv[argc++] = buf;
+	    *delim = '\0';
+	    buf = delim + 1;
+	} else {
+	    /* A word ends at a space or at a '|', which is its own token */
+	    delim = buf + strcspn(buf, " |");
+	    argv[argc++] = buf;
+	    if (*delim == '|')
+		argv[argc++] = pipetok;
+	    buf = *delim ? delim + 1 : delim;
+	    *delim = '\0';
 	}
+	while (*buf && (*buf == ' ')) /* ignore spaces */
+	       buf++;
     }
     argv[argc] = NULL;
     
@@ -69,6 +110,238 @@ int parseline(const char *cmdline, char **argv)
     return bg;
 }
 
+/*
+ * optoken - If an operator that may start a word starts at s, return
+ *     its token and store its length in *len, otherwise return NULL.
+ *     Never looks at or past end.
+ */
+static char *optoken(const char *s, const char *end, int *len)
+{
+    switch (*s) {
+    case '<':
+	*len = 1;
+	return intok;
+    case '>':
+	*len = (s + 1 < end && s[1] == '>') ? 2 : 1;
+	return *len == 2 ? appendtok : outtok;
+    case '&':
+	*len = 1;
+	return bgtok;
+    case '2':
+	if (s + 1 == end || s[1] != '>')
+	    return NULL;
+	if (s + 3 < end && s[2] == '&' && s[3] == '1') {
+	    *len = 4;
+	    return errouttok;
+	}
+	*len = (s + 2 < end && s[2] == '>') ? 3 : 2;
+	return *len == 3 ? errappendtok : errtok;
+    }
+    return NULL;
+}
+
+/*
+ * ctltoken - If a |, ||, &&, or ; starts at s, return its token and
+ *     store its length in *len, otherwise return NULL. These end a
+ *     word wherever they are.
+ */
+static char *ctltoken(const char *s, const char *end, int *len)
+{
+    int two = s + 1 < end && s[1] == *s;
+
+    *len = 1;
+    switch (*s) {
+    case '|':
+	*len += two;
+	return two ? ortok : pipetok;
+    case ';':
+	return semitok;
+    case '&':
+	*len += two;
+	return two ? andtok : NULL;
+    }
+    return NULL;
+}
+
+/* isvarstart - Can c follow a $ that starts an expansion? */
+static int isvarstart(int c)
+{
+    return isalpha((unsigned char) c) || c == '_' || c == '{' || c == '?';
+}
+
+/*
+ * arenafit - Make arena big enough to tokenize a line of len bytes.
+ *     A line of len bytes has at most len words, and its words take
+ *     at most len + 1 bytes with their terminators, so the arena only
+ *     grows when a line longer than any before it comes along.
+ *     Returns 0, or -1 if memory ran out.
+ */
+int arenafit(struct arena_t *arena, size_t len)
+{
+    size_t size = arena->size ? arena->size : MAXLINE;
+    char *buf;
+    char **argv;
+
+    if (arena->buf != NULL && len <= arena->size)
+	return 0;
+    while (size < len)
+	size *= 2;
+    if ((buf = realloc(arena->buf, size + 1)) == NULL)
+	return -1;
+    arena->buf = buf;
+    if ((argv = realloc(arena->argv, (size + 1) * sizeof(char *))) == NULL)
+	return -1;
+    arena->argv = argv;
+    arena->size = size;
+    return 0;
+}
+
+/*
+ * tokenize - Split the len bytes at line into words in one pass,
+ *     copying them into arena, which arenafit must have sized for
+ *     len. The words end up in arena->argv, NULL terminated, with
+ *     their count in arena->argc. Nothing is allocated and no state
+ *     is kept between calls, so the words of one line stay valid
+ *     while another arena is filled.
+ *
+ * Words are separated by blanks and newlines. Single quotes keep
+ * everything up to the closing quote; double quotes do too, except
+ * that a backslash escapes $, `, ", \ or a newline. Outside quotes a
+ * backslash escapes a blank, a quote, a backslash or an operator
+ * character and joins lines when it ends one; before anything else it
+ * is kept, so "\046" reaches /bin/echo -e intact. Quoted and unquoted
+ * pieces next to each other form one word.
+ *
+ * Operators come back as the tokens themselves, as in parseline: an
+ * unquoted |, ||, &&, ; or newline anywhere (but the newline ending
+ * the text), and <, >, >>, 2>, 2>>, 2>&1 and & only at the start of a
+ * word. A trailing & is removed and reported. A $ that starts a $NAME,
+ * ${NAME} or $? outside single quotes is stored as VARMARK, for the
+ * caller to expand; a backslash keeps it a plain $. arena->plain says
+ * whether the line is one simple command with nothing to expand.
+ * Returns 1 if the job should run in the background, 0 if not, or -1
+ * if a quote is never closed.
+ */
+int tokenize(const char *line, size_t len, struct arena_t *arena)
+{
+    const char *s = line, *end = line + len;
+    char *d = arena->buf, **argv = arena->argv, *tok;
+    int argc = 0, inword = 0, nctl = 0, n;
+
+    while (s < end) {
+	switch (*s) {
+	case ' ':
+	case '\t':
+	case '\n':
+	    if (inword) {
+		*d++ = '\0';
+		inword = 0;
+	    }
+	    if (*s == '\n' && s + 1 < end) {
+		argv[argc++] = nltok;
+		nctl++;
+	    }
+	    s++;
+	    continue;
+	case '|':
+	case ';':
+	case '&':
+	    if ((tok = ctltoken(s, end, &n)) == NULL)
+		break;              /* a lone & is left to optoken */
+	    if (inword) {
+		*d++ = '\0';
+		inword = 0;
+	    }
+	    argv[argc++] = tok;
+	    nctl += tok != pipetok;
+	    s += n;
+	    continue;
+	case '\\':
+	    if (s + 1 < end && s[1] == '\n') {   /* line continuation */
+		s += 2;
+		continue;
+	    }
+	    break;
+	}
+	if (!inword) {
+	    if ((tok = optoken(s, end, &n)) != NULL) {
+		argv[argc++] = tok;
+		nctl += tok == bgtok;
+		s += n;
+		continue;
+	    }
+	    argv[argc++] = d;
+	    inword = 1;
+	}
+
+	switch (*s) {
+	case '\'':
+	    for (s++; s < end && *s != '\''; s++)
+		*d++ = *s;
+	    if (s++ == end)
+		return -1;
+	    break;
+	case '"':
+	    for (s++; s < end && *s != '"'; s++) {
+		if (*s == '\\' && s + 1 < end) {
+		    switch (s[1]) {
+		    case '\n':
+			s++;
+			continue;
+		    case '$': case '`': case '"': case '\\':
+			s++;
+			break;
+		    }
+		} else if (*s == '$' && s + 1 < end && isvarstart(s[1])) {
+		    *d++ = VARMARK;
+		    nctl++;
+		    continue;
+		}
+		*d++ = *s;
+	    }
+	    if (s++ == end)
+		return -1;
+	    break;
+	case '\\':
+	    if (s + 1 < end) {
+		switch (s[1]) {
+		case ' ': case '\t': case '\'': case '"': case '\\':
+		case '|': case '&': case '<': case '>': case ';': case '$':
+		    s++;
+		    break;
+		}
+	    }
+	    *d++ = *s++;
+	    break;
+	case '$':
+	    if (s + 1 < end && isvarstart(s[1])) {
+		*d++ = VARMARK;
+		nctl++;
+		s++;
+		break;
+	    }
+	    *d++ = *s++;
+	    break;
+	default:
+	    *d++ = *s++;
+	}
+    }
+    if (inword)
+	*d = '\0';
+
+    /* should the job run in the background? */
+    if (argc > 0 && argv[argc - 1] == bgtok) {
+	argv[--argc] = NULL;
+	arena->argc = argc;
+	arena->plain = nctl == 1;
+	return 1;
+    }
+    argv[argc] = NULL;
+    arena->argc = argc;
+    arena->plain = nctl == 0;
+    return 0;
+}
+
 /*
  * unix_error - unix-style error routine
  */
@@ -102,3 +375,52 @@ handler_t *Signal(int signum, handler_t *handler)
 	unix_error("Signal error");
     return (old_action.sa_handler);
 }
+
+/*
+ * The sio_ routines format output into a struct sio_t using only
+ * async-signal-safe operations, so a handler can describe several
+ * events and hand them to the kernel with a single write.
+ */
+
+/* sio_flush - Write out and empty the buffer */
+void sio_flush(struct sio_t *sp)
+{
+    int n, off = 0;
+
+    while (off < sp->len) {
+	if ((n = write(STDOUT_FILENO, sp->buf + off, sp->len - off)) < 0) {
+	    if (errno == EINTR)
+		continue;
+	    _exit(1);
+	}
+	off += n;
+    }
+    sp->len = 0;
+}
+
+/* sio_puts - Append a string */
+void sio_puts(struct sio_t *sp, const char *s)
+{
+    while (*s) {
+	if (sp->len == SIOBUF)
+	    sio_flush(sp);
+	sp->buf[sp->len++] = *s++;
+    }
+}
+
+/* sio_putl - Append a long in decimal */
+void sio_putl(struct sio_t *sp, long v)
+{
+    char digits[24];
+    int i = sizeof(digits) - 1;
+    unsigned long u = v < 0 ? -(unsigned long) v : (unsigned long) v;
+
+    digits[i] = '\0';
+    do {
+	digits[--i] = '0' + u % 10;
+	u /= 10;
+    } while (u);
+    if (v < 0)
+	digits[--i] = '-';
+    sio_puts(sp, &digits[i]);
+}
@@ -3,13 +3,44 @@
 /* Misc manifest constants */
 #define MAXLINE    1024   /* max line size */
 #define MAXARGS     128   /* max args on a command line */
-#define MAXJOBS      16   /* max jobs at any point in time */
-#define MAXJID    1<<16   /* max job ID */
+#define MAXSTAGES    32   /* max commands in a pipeline */
+#define MAXREDIRS     8   /* max redirections on one command */
+#define INITJOBS     16   /* initial job table size (grows on demand) */
+#define MAXJID  (1<<16)   /* max job ID */
+
+#define SIOBUF     4096   /* async-signal-safe output buffer size */
+
+/* Output buffer a signal handler can fill and write out in one go */
+struct sio_t {
+    int len;               /* bytes waiting in buf */
+    char buf[SIOBUF];
+};
+
+/* Storage for the words of one line, sized by arenafit */
+struct arena_t {
+    char *buf;             /* the words, each NUL terminated */
+    char **argv;           /* pointers to the words, NULL terminated */
+    int argc;              /* number of words */
+    int plain;             /* no ;, &&, ||, newline, inner & or $ */
+    size_t size;           /* longest line the arena can take */
+};
+
+extern char pipetok[];
+extern char intok[], outtok[], appendtok[];
+extern char errtok[], errappendtok[], errouttok[], bgtok[];
+extern char semitok[], andtok[], ortok[], nltok[];
+
+#define VARMARK '\001'    /* stands for a $ to expand in tokenize's words */
 
 int parseline(const char *cmdline, char **argv); 
+int arenafit(struct arena_t *arena, size_t len);
+int tokenize(const char *line, size_t len, struct arena_t *arena);
 void unix_error(char *msg);
 void app_error(char *msg);
 typedef void handler_t(int);
 handler_t *Signal(int signum, handler_t *handler);
+void sio_puts(struct sio_t *sp, const char *s);
+void sio_putl(struct sio_t *sp, long v);
+void sio_flush(struct sio_t *sp);
 
 #endif
@@ -0,0 +1,259 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "util.h"
+#include "vars.h"
+
+/*
+ * Variables are kept in a small chained hash table, filled from the
+ * environment the shell was started with. Exported ones make up the
+ * environment of the jobs the shell starts: varenv builds that envp
+ * array only when an exported variable has changed since it last
+ * did, and until the first change it is environ itself, so starting
+ * a job normally copies nothing.
+ */
+
+#define VARBUCKETS 64               /* hash buckets (power of 2) */
+
+struct var_t {                      /* A shell variable */
+    struct var_t *next;             /* next in the same bucket */
+    char *name;
+    char *value;                    /* NULL if only exported so far */
+    int exported;                   /* in the environment of jobs */
+};
+
+extern char **environ;              /* defined in libc */
+
+static struct var_t *vartab[VARBUCKETS];
+unsigned long vargen = 1;           /* bumped by every change */
+static unsigned long envgen;        /* bumped when the environment changes */
+static unsigned long envbuilt;      /* envgen that envp was built for */
+static char **envp;                 /* the environment, once it changed */
+
+
+/* varhash - Hash the len bytes of a variable name */
+static unsigned int varhash(const char *s, size_t len)
+{
+    unsigned int h = 5381;
+
+    while (len-- > 0)
+	h = h * 33 + (unsigned char) *s++;
+    return h & (VARBUCKETS - 1);
+}
+
+/* findvar - The variable whose name is the len bytes at name, or NULL */
+static struct var_t *findvar(const char *name, size_t len)
+{
+    struct var_t *v;
+
+    for (v = vartab[varhash(name, len)]; v != NULL; v = v->next)
+	if (!strncmp(v->name, name, len) && v->name[len] == '\0')
+	    return v;
+    return NULL;
+}
+
+/*
+ * putvar - Set the variable named by the len bytes at name to a copy
+ *     of value (which may be NULL), creating it if need be, and export
+ *     it too if export is set. Returns 0, or -1 if memory ran out.
+ */
+static int putvar(const char *name, size_t len, const char *value,
+		  int export)
+{
+    struct var_t *v = findvar(name, len);
+    unsigned int h;
+    char *copy = NULL;
+
+    if (v != NULL && (v->exported || !export) && (value == NULL
+	|| (v->value != NULL && !strcmp(v->value, value))))
+	return 0;
+    if (value != NULL && (copy = strdup(value)) == NULL)
+	return -1;
+    if (v == NULL) {
+	if ((v = calloc(1, sizeof(*v))) == NULL
+	    || (v->name = strndup(name, len)) == NULL) {
+	    free(v);
+	    free(copy);
+	    return -1;
+	}
+	h = varhash(name, len);
+	v->next = vartab[h];
+	vartab[h] = v;
+    }
+    if (value != NULL) {
+	free(v->value);
+	v->value = copy;
+    }
+    v->exported |= export;
+    vargen++;
+    if (v->exported && v->value != NULL)
+	envgen++;
+    return 0;
+}
+
+/*
+ * varinit - Make a variable of each NAME=value in env, exported. This
+ *     is not a change: jobs still get env until one is made.
+ */
+void varinit(char **env)
+{
+    char *eq;
+
+    for (; *env != NULL; env++)
+	if ((eq = strchr(*env, '=')) != NULL && eq > *env
+	    && putvar(*env, eq - *env, eq + 1, 1) < 0)
+	    unix_error("varinit error");
+    envgen = 0;
+}
+
+/*
+ * isname - Are the len bytes at s a variable name: a letter or
+ *     underscore, then letters, digits and underscores?
+ */
+int isname(const char *s, size_t len)
+{
+    size_t i;
+
+    if (len == 0 || !(isalpha((unsigned char) *s) || *s == '_'))
+	return 0;
+    for (i = 1; i < len; i++)
+	if (!(isalnum((unsigned char) s[i]) || s[i] == '_'))
+	    return 0;
+    return 1;
+}
+
+/* isassign - Is word a NAME=value assignment? */
+int isassign(const char *word)
+{
+    const char *eq = strchr(word, '=');
+
+    return eq != NULL && isname(word, eq - word);
+}
+
+/* getvar - The value of variable name, or NULL if it is not set */
+const char *getvar(const char *name)
+{
+    struct var_t *v = findvar(name, strlen(name));
+
+    return v != NULL ? v->value : NULL;
+}
+
+/*
+ * setvar - Set variable name to a copy of value. Setting it to the
+ *     value it has is not a change. Returns 0, or -1 if memory ran out.
+ */
+int setvar(const char *name, const char *value)
+{
+    return putvar(name, strlen(name), value, 0);
+}
+
+/*
+ * setassign - Set the variable of a NAME=value word, which isassign
+ *     has passed, exporting it if export is set. Returns 0, or -1 if
+ *     memory ran out.
+ */
+int setassign(const char *word, int export)
+{
+    const char *eq = strchr(word, '=');
+
+    return putvar(word, eq - word, eq + 1, export);
+}
+
+/*
+ * exportvar - Put variable name in the environment of jobs, from now
+ *     on whenever it has a value. Returns 0, or -1 if memory ran out.
+ */
+int exportvar(const char *name)
+{
+    return putvar(name, strlen(name), NULL, 1);
+}
+
+/* unsetvar - Forget variable name */
+void unsetvar(const char *name)
+{
+    size_t len = strlen(name);
+    struct var_t **pv, *v;
+
+    for (pv = &vartab[varhash(name, len)]; (v = *pv) != NULL; pv = &v->next)
+	if (!strcmp(v->name, name))
+	    break;
+    if (v == NULL)
+	return;
+    *pv = v->next;
+    vargen++;
+    if (v->exported && v->value != NULL)
+	envgen++;
+    free(v->name);
+    free(v->value);
+    free(v);
+}
+
+/*
+ * varenv - The environment for jobs, as a NULL terminated envp, with
+ *     a number that changes whenever its contents do in *gen if gen is
+ *     not NULL. The array is built again only after a change and is
+ *     good until the next call. Returns NULL if memory ran out.
+ */
+char **varenv(unsigned long *gen)
+{
+    struct var_t *v;
+    size_t size = 0;
+    char **e, *s;
+    int i, n = 0;
+
+    if (gen != NULL)
+	*gen = envgen;
+    if (envgen == 0)
+	return environ;
+    if (envbuilt == envgen)
+	return envp;
+
+    /* One block: the pointers, then the NAME=value strings */
+    for (i = 0; i < VARBUCKETS; i++)
+	for (v = vartab[i]; v != NULL; v = v->next)
+	    if (v->exported && v->value != NULL) {
+		n++;
+		size += strlen(v->name) + strlen(v->value) + 2;
+	    }
+    if ((e = malloc((n + 1) * sizeof(char *) + size)) == NULL)
+	return NULL;
+    s = (char *) (e + n + 1);
+    n = 0;
+    for (i = 0; i < VARBUCKETS; i++)
+	for (v = vartab[i]; v != NULL; v = v->next)
+	    if (v->exported && v->value != NULL) {
+		e[n++] = s;
+		s += sprintf(s, "%s=%s", v->name, v->value) + 1;
+	    }
+    e[n] = NULL;
+    free(envp);
+    envp = e;
+    envbuilt = envgen;
+    return envp;
+}
+
+/* listexports - Print the exported variables, as export would set them */
+void listexports(void)
+{
+    struct var_t *v;
+    const char *s;
+    int i;
+
+    for (i = 0; i < VARBUCKETS; i++)
+	for (v = vartab[i]; v != NULL; v = v->next) {
+	    if (!v->exported)
+		continue;
+	    printf("export %s", v->name);
+	    if (v->value != NULL) {
+		printf("='");
+		for (s = v->value; *s != '\0'; s++)
+		    if (*s == '\'')
+			printf("'\\''");
+		    else
+			putchar(*s);
+		putchar('\'');
+	    }
+	    putchar('\n');
+	}
+}
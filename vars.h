@@ -0,0 +1,23 @@
+#ifndef _VARS_H_
+#define _VARS_H_
+
+#include <stddef.h>
+
+/*
+ * Shell variables. vargen changes whenever a variable does, so what
+ * was expanded from them can be kept until it does.
+ */
+extern unsigned long vargen;
+
+void varinit(char **env);
+int isname(const char *s, size_t len);
+int isassign(const char *word);
+const char *getvar(const char *name);
+int setvar(const char *name, const char *value);
+int setassign(const char *word, int export);
+int exportvar(const char *name);
+void unsetvar(const char *name);
+char **varenv(unsigned long *gen);
+void listexports(void);
+
+#endif